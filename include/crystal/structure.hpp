@@ -4,36 +4,76 @@
 
 #include <Eigen/Dense>
 
-#include <map>
+#include <optional>
+#include <span>
 #include <vector>
 
 namespace defect_gnn::crystal {
 
-class Atom {
-public:
-    int element;
-    Eigen::Vector3d position;
-    Eigen::Vector3d frac_position;
-};
-
+// Atoms are stored as structure-of-arrays: one contiguous array per coordinate, so the
+// minimum-image kernels stream over all atoms with packet math.
 class Structure {
 public:
     explicit Structure(const io::VASPStructure& vasp);
 
     [[nodiscard]] const Eigen::Matrix3d& lattice() const;
-    [[nodiscard]] const std::vector<Atom>& atoms() const;
     [[nodiscard]] size_t num_atoms() const;
 
+    [[nodiscard]] int element(size_t i) const { return elements_[i]; }
+    [[nodiscard]] Eigen::Vector3d position(size_t i) const { return {x_[i], y_[i], z_[i]}; }
+    [[nodiscard]] Eigen::Vector3d frac_position(size_t i) const {
+        return {frac_x_[i], frac_y_[i], frac_z_[i]};
+    }
+
+    [[nodiscard]] std::span<const int> elements() const { return elements_; }
+    [[nodiscard]] std::span<const double> x() const { return x_; }
+    [[nodiscard]] std::span<const double> y() const { return y_; }
+    [[nodiscard]] std::span<const double> z() const { return z_; }
+    [[nodiscard]] std::span<const double> frac_x() const { return frac_x_; }
+    [[nodiscard]] std::span<const double> frac_y() const { return frac_y_; }
+    [[nodiscard]] std::span<const double> frac_z() const { return frac_z_; }
+
     [[nodiscard]] double distance(size_t i, size_t j) const;
     [[nodiscard]] Eigen::Vector3d displacement(size_t i, size_t j) const;
+
+    // Minimum-image distances from atom i to every atom; out must hold num_atoms() values
+    void distances_from(size_t i, std::span<double> out) const;
+    void distances_from(size_t i, std::span<float> out) const;
+
     [[nodiscard]] Eigen::MatrixXd compute_distance_matrix() const;
+    [[nodiscard]] Eigen::MatrixXf compute_distance_matrix_f32() const;
 
     [[nodiscard]] int count(int element) const;
 
 private:
+    template <typename Real>
+    void distance_tile(size_t i, size_t begin, size_t end, Real* out) const;
+
     Eigen::Matrix3d lattice_;
     Eigen::Matrix3d inv_lattice_;
-    std::vector<Atom> atoms_;
-    std::map<int, int> counts_;
+
+    std::vector<int> elements_;
+    std::vector<double> x_;
+    std::vector<double> y_;
+    std::vector<double> z_;
+    std::vector<double> frac_x_;
+    std::vector<double> frac_y_;
+    std::vector<double> frac_z_;
+
+    // Atoms per element, indexed by element
+    std::vector<int> counts_;
 };
-}  // namespace defect_gnn::crystal
\ No newline at end of file
+
+// How a single-vacancy structure relates to its host: `removed` is the host atom that is missing
+// and host_index[i] is the host atom that vacancy atom i corresponds to.
+struct VacancyMap {
+    size_t removed;
+    std::vector<size_t> host_index;
+};
+
+// Matches `vacancy` against `host` as the same cell with one atom removed, allowing for a rigid
+// translation and a different atom order. Returns nullopt when the structures are not related
+// that way within `tolerance` (Angstrom).
+[[nodiscard]] std::optional<VacancyMap>
+match_vacancy(const Structure& host, const Structure& vacancy, double tolerance = 1e-4);
+}  // namespace defect_gnn::crystal
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "crystal/structure.hpp"
+
+#include <Eigen/Dense>
+
+#include <vector>
+
+namespace defect_gnn::crystal {
+
+// Space-group operation in fractional coordinates, x' = rotation * x + translation (mod 1).
+// permutation[i] is the atom that atom i is mapped onto.
+struct SymmetryOperation {
+    Eigen::Matrix3i rotation;
+    Eigen::Vector3d translation;
+    std::vector<size_t> permutation;
+};
+
+// Operations that map the structure onto itself with every atom landing on an atom of the same
+// element within `tolerance` (Angstrom). Rotations are searched among integer matrices with
+// entries in {-1, 0, 1} that preserve the lattice metric, which covers every point-group
+// operation of a reduced cell; a non-reduced cell may report a subgroup.
+[[nodiscard]] std::vector<SymmetryOperation> find_symmetry_operations(const Structure& structure,
+                                                                      double tolerance = 1e-4);
+
+// For each atom, the smallest atom index in its orbit under the symmetry operations
+[[nodiscard]] std::vector<size_t> find_equivalent_atoms(const Structure& structure,
+                                                        double tolerance = 1e-4);
+
+}  // namespace defect_gnn::crystal
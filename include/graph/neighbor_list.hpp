@@ -4,24 +4,99 @@
 
 #include <Eigen/Dense>
 
+#include <cstdint>
 #include <nanoflann.hpp>
+#include <span>
 #include <vector>
 
 namespace defect_gnn::graph {
+
+// KDTree replicates the cell into a periodic image cloud and radius-searches it.
+// CellList bins fractional coordinates into a periodic grid and walks neighboring bins with
+// lattice-offset wrapping, so nothing is replicated. Both return the same neighbor sets.
+enum class NeighborBackend { KDTree, CellList };
+
+// Candidate record used while sorting one atom's search results; the stored lists are CSR.
 struct Neighbor {
     size_t idx;
     double distance;
     Eigen::Vector3d displacement;
 };
 
+// One atom's slice of a NeighborTable
+template <typename Real>
+struct NeighborView {
+    std::span<const uint32_t> indices;
+    std::span<const Real> distances;
+    std::span<const Real> dx;
+    std::span<const Real> dy;
+    std::span<const Real> dz;
+
+    [[nodiscard]] size_t size() const { return indices.size(); }
+    [[nodiscard]] bool empty() const { return indices.empty(); }
+    [[nodiscard]] Eigen::Vector3d displacement(size_t k) const { return {dx[k], dy[k], dz[k]}; }
+};
+
+// Flat CSR neighbor storage: atom i's neighbors occupy [offsets[i], offsets[i + 1]) of every
+// per-edge array, sorted by distance.
+template <typename Real>
+struct NeighborTable {
+    std::vector<size_t> offsets{0};
+    std::vector<uint32_t> indices;
+    std::vector<Real> distances;
+    std::vector<Real> dx;
+    std::vector<Real> dy;
+    std::vector<Real> dz;
+
+    [[nodiscard]] size_t num_atoms() const { return offsets.size() - 1; }
+    [[nodiscard]] size_t num_edges() const { return indices.size(); }
+
+    [[nodiscard]] NeighborView<Real> row(size_t atom_idx) const {
+        size_t begin = offsets[atom_idx];
+        size_t count = offsets[atom_idx + 1] - begin;
+
+        return {std::span(indices).subspan(begin, count),
+                std::span(distances).subspan(begin, count),
+                std::span(dx).subspan(begin, count),
+                std::span(dy).subspan(begin, count),
+                std::span(dz).subspan(begin, count)};
+    }
+};
+
 class NeighborList {
 public:
+    // The search runs on at most num_threads OpenMP threads, 0 leaving the count to OpenMP. Lists
+    // derived with filtered() or with_vacancy() keep the same limit.
     explicit NeighborList(const crystal::Structure& structure,
                           double r_cutoff = 10.0,
                           size_t max_neighbors = 20,
-                          double epsilon = 1e-10);
-
-    [[nodiscard]] const std::vector<Neighbor>& neighbors(size_t atom_idx) const;
+                          double epsilon = 1e-10,
+                          NeighborBackend backend = NeighborBackend::KDTree,
+                          unsigned num_threads = 0);
+
+    [[nodiscard]] NeighborView<double> neighbors(size_t atom_idx) const;
+    [[nodiscard]] const NeighborTable<double>& table() const { return table_; }
+
+    [[nodiscard]] size_t num_atoms() const { return table_.num_atoms(); }
+    [[nodiscard]] size_t num_edges() const { return table_.num_edges(); }
+    [[nodiscard]] double r_cutoff() const { return r_cutoff_; }
+    [[nodiscard]] size_t max_neighbors() const { return max_neighbors_; }
+
+    // Whether filtered(r_cutoff, max_neighbors) can be served from this list
+    [[nodiscard]] bool covers(double r_cutoff, size_t max_neighbors) const {
+        return r_cutoff <= r_cutoff_ && max_neighbors <= max_neighbors_;
+    }
+
+    // List for a smaller cutoff and/or max_neighbors, taken as a prefix of every sorted row in
+    // O(edges) without searching again. Throws if the request is not covered by this list.
+    [[nodiscard]] NeighborList filtered(double r_cutoff, size_t max_neighbors) const;
+
+    // Neighbor list of `host` with one atom removed, derived from this list (built on `host`)
+    // instead of searching again. Rows follow the vacancy structure's atom order.
+    [[nodiscard]] NeighborList with_vacancy(const crystal::Structure& host,
+                                            const crystal::VacancyMap& vacancy) const;
+    // Same, keeping the host order with the atoms after `removed` shifted down by one
+    [[nodiscard]] NeighborList with_vacancy(const crystal::Structure& host, size_t removed) const;
 
 private:
     class PointCloud {
@@ -36,14 +111,14 @@ private:
             return false;
         }
 
-        void add_point(const Eigen::Vector3d& position, size_t original_index) {
-            positions_.push_back(position);
-            original_indices_.push_back(original_index);
+        void set_point(size_t idx, const Eigen::Vector3d& position, size_t original_index) {
+            positions_[idx] = position;
+            original_indices_[idx] = original_index;
         }
 
-        void reserve(size_t n) {
-            positions_.reserve(n);
-            original_indices_.reserve(n);
+        void resize(size_t n) {
+            positions_.resize(n);
+            original_indices_.resize(n);
         }
 
         [[nodiscard]] const Eigen::Vector3d& position(size_t idx) const { return positions_[idx]; }
@@ -57,17 +132,39 @@ private:
     using KDTree = nanoflann::
         KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, PointCloud>, PointCloud, 3>;
 
-    [[nodiscard]] static int compute_num_images(const Eigen::Matrix3d& lattice, double r_cutoff);
+    [[nodiscard]] static Eigen::Vector3i compute_num_images(const Eigen::Matrix3d& lattice,
+                                                            double r_cutoff);
     [[nodiscard]] static PointCloud create_image_cloud(const crystal::Structure& structure,
-                                                       int num_images);
-
-    void build_with_pbc(const crystal::Structure& structure);
+                                                       const Eigen::Vector3i& num_images,
+                                                       double r_cutoff,
+                                                       unsigned num_threads);
+
+    [[nodiscard]] static Eigen::Vector3d perpendicular_heights(const Eigen::Matrix3d& lattice);
+
+    NeighborList(double r_cutoff,
+                 size_t max_neighbors,
+                 double epsilon,
+                 NeighborBackend backend,
+                 unsigned num_threads);
+
+    // Searches neighbors of query_atoms only, keeping at most max_neighbors per row
+    [[nodiscard]] NeighborTable<double> search(const crystal::Structure& structure,
+                                               std::span<const size_t> query_atoms,
+                                               size_t max_neighbors) const;
+    [[nodiscard]] NeighborTable<double> build_with_pbc(const crystal::Structure& structure,
+                                                       std::span<const size_t> query_atoms,
+                                                       size_t max_neighbors) const;
+    [[nodiscard]] NeighborTable<double> build_with_cell_list(const crystal::Structure& structure,
+                                                             std::span<const size_t> query_atoms,
+                                                             size_t max_neighbors) const;
 
     double r_cutoff_;
     size_t max_neighbors_;
     double epsilon_;
+    NeighborBackend backend_;
+    unsigned num_threads_;
 
-    std::vector<std::vector<Neighbor>> neighbor_lists_;
+    NeighborTable<double> table_;
 };
 
 }  // namespace defect_gnn::graph
\ No newline at end of file
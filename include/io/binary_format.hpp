@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace defect_gnn::io {
+
+// Element type of a stored array. F32 and BF16 round the doubles on write and widen them on read.
+enum class Dtype : uint8_t { F64 = 0, F32 = 1, BF16 = 2 };
+
+// RAW stores the elements as they are. SHUFFLE_DELTA replaces each element's bits with the
+// difference to the previous element's, groups byte k of every element together and run-length
+// encodes the zero bytes; lossless, and effective on columns of similar or repeated values.
+enum class Codec : uint8_t { RAW = 0, SHUFFLE_DELTA = 1 };
+
+struct ArrayEncoding {
+    Dtype dtype = Dtype::F64;
+    Codec codec = Codec::RAW;
+};
+
+// "f64", "f32" or "bf16"
+[[nodiscard]] Dtype parse_dtype(const std::string& name);
+
+// Self-describing file of column-major double matrices. Layout (native byte order):
+//   magic "DGNNARR\0", uint32 byte-order tag 0x01020304, uint16 version, uint16 array count
+//   per array: uint8 dtype, uint8 codec, 6 zero bytes, uint64 rows, uint64 cols,
+//              uint64 payload size, payload
+//   uint64 FNV-1a of every preceding byte
+class ArrayWriter {
+public:
+    explicit ArrayWriter(ArrayEncoding encoding = {});
+
+    void add(const Eigen::Ref<const Eigen::MatrixXd>& array);
+    void save(const std::string& filepath) const;
+
+private:
+    ArrayEncoding encoding_;
+    uint16_t num_arrays_ = 0;
+    std::string body_;
+};
+
+// Reads a file written by ArrayWriter that must hold `expected_arrays` arrays. Throws on a wrong
+// magic, version or byte order, a checksum mismatch, truncation or a payload that does not decode
+// to its stated shape, before returning anything.
+[[nodiscard]] std::vector<Eigen::MatrixXd> read_arrays(const std::string& filepath,
+                                                       size_t expected_arrays);
+
+}  // namespace defect_gnn::io
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace defect_gnn::io {
+
+// What a run produced from one input: the hash of the input file, of the parameters it was
+// processed with, and of each output file in a fixed order
+struct ManifestEntry {
+    std::string id;
+    uint64_t input_hash = 0;
+    uint64_t params_hash = 0;
+    std::vector<uint64_t> output_checksums;
+};
+
+// Append-only record of finished outputs, one line per entry, flushed as each one is added so a
+// run killed midway keeps everything it completed. When an id appears more than once the last line
+// wins; an incomplete last line from a crash is ignored. Safe to use from several threads.
+class Manifest {
+public:
+    explicit Manifest(std::string filepath);
+
+    [[nodiscard]] std::optional<ManifestEntry> find(const std::string& id) const;
+    void append(const ManifestEntry& entry);
+
+    [[nodiscard]] size_t size() const;
+
+private:
+    std::string filepath_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, ManifestEntry> entries_;
+    bool torn_tail_ = false;  // the file ends in an incomplete line
+};
+
+}  // namespace defect_gnn::io
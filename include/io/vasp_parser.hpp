@@ -3,6 +3,7 @@
 #include <Eigen/Dense>
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace defect_gnn::io {
@@ -15,6 +16,11 @@ struct VASPStructure {
     std::vector<int> atom_types;
 };
 
+// Memory-maps the file and parses it in place
 VASPStructure parse_vasp(const std::string& filepath);
 
-}  // namespace defect_gnn::io
\ No newline at end of file
+// Parses POSCAR text held in memory, without copying it or splitting it into lines. `source` only
+// names the input in error messages. Throws on missing lines or malformed numbers.
+VASPStructure parse_vasp_string(std::string_view content, std::string_view source = "<string>");
+
+}  // namespace defect_gnn::io
@@ -2,10 +2,15 @@
 
 #include "crystal/structure.hpp"
 #include "graph/neighbor_list.hpp"
+#include "io/binary_format.hpp"
+#include "topology/feature_cache.hpp"
 #include "topology/ripser_wrapper.hpp"
+#include "utils/task_scheduler.hpp"
 
 #include <Eigen/Dense>
 
+#include <span>
+#include <string>
 #include <vector>
 
 namespace defect_gnn::topology {
@@ -24,6 +29,9 @@ inline void append_to(BettiStatistics stats, std::vector<double>& vec) {
     vec.insert(vec.end(), {stats.mean, stats.std, stats.max, stats.min, stats.weighted_sum});
 }
 
+// Human-readable name of a feature column, e.g. "dim1 birth mean"
+std::string betti_feature_name(int index);
+
 BettiStatistics compute_statistics(const PersistenceDiagram& diagram,
                                    const std::string& values_type,
                                    double weight = 1.0);
@@ -32,14 +40,44 @@ Eigen::VectorXd compute_atom_betti_features(const crystal::Structure& structure,
                                             size_t atom_idx,
                                             const graph::NeighborList& neighbor_list,
                                             double r_cutoff,
-                                            unsigned num_threads);
+                                            unsigned num_threads,
+                                            const PersistenceOptions& options = {});
 
+// With a cache, atoms whose local environment was already seen reuse the stored row
 Eigen::MatrixXd compute_structure_betti_features(const crystal::Structure& structure,
                                                  double r_cutoff = 10,
-                                                 unsigned num_threads = 8);
+                                                 unsigned num_threads = 8,
+                                                 FeatureCache* cache = nullptr,
+                                                 const PersistenceOptions& options = {});
+
+// Same, with a prebuilt unbounded neighbor list at r_cutoff (e.g. derived from a host structure)
+Eigen::MatrixXd compute_structure_betti_features(const crystal::Structure& structure,
+                                                 const graph::NeighborList& neighbor_list,
+                                                 double r_cutoff,
+                                                 unsigned num_threads = 8,
+                                                 FeatureCache* cache = nullptr,
+                                                 const PersistenceOptions& options = {});
+
+// One feature matrix per cutoff from a single unbounded neighbor list at the largest of them.
+// Each matrix equals the single-cutoff result at that cutoff.
+// With a scheduler, the atoms become single-threaded tasks on its pool, ordered by
+// estimate_persistence_cost together with those of other structures in flight, and num_threads is
+// ignored.
+std::vector<Eigen::MatrixXd>
+compute_structure_betti_features(const crystal::Structure& structure,
+                                 const graph::NeighborList& neighbor_list,
+                                 std::span<const double> r_cutoffs,
+                                 unsigned num_threads = 8,
+                                 FeatureCache* cache = nullptr,
+                                 const PersistenceOptions& options = {},
+                                 utils::TaskScheduler* scheduler = nullptr);
 
-void save_betti_features(const std::string& filepath, const Eigen::MatrixXd& features);
+// Stored with io::ArrayWriter; f32/bf16 round the features, the codec is lossless
+void save_betti_features(const std::string& filepath,
+                         const Eigen::MatrixXd& features,
+                         io::ArrayEncoding encoding = {});
 
+// Throws on any file that is not a complete, intact feature matrix
 Eigen::MatrixXd load_betti_features(const std::string& filepath);
 
 }  // namespace defect_gnn::topology
\ No newline at end of file
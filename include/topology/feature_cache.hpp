@@ -0,0 +1,61 @@
+#pragma once
+
+#include "graph/neighbor_list.hpp"
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+namespace defect_gnn::topology {
+
+// 128-bit digest of a local environment; `hash` buckets it and `check` guards against collisions
+struct EnvironmentKey {
+    uint64_t hash = 0;
+    uint64_t check = 0;
+
+    bool operator==(const EnvironmentKey&) const = default;
+};
+
+struct EnvironmentKeyHash {
+    size_t operator()(const EnvironmentKey& key) const { return key.hash; }
+};
+
+// Canonical fingerprint of one atom's neighborhood: the sorted (center distance, species) pairs,
+// the sorted neighbor-neighbor distances up to `threshold`, the threshold itself and any landmark
+// radius of an approximate run, all quantized to `resolution` (Angstrom). species[0] is the
+// center, species[k + 1] neighbor k. Invariant to rotation, translation and neighbor order.
+[[nodiscard]] EnvironmentKey fingerprint_environment(const graph::NeighborView<double>& neighbors,
+                                                     std::span<const int> species,
+                                                     double threshold,
+                                                     double landmark_radius = 0.0,
+                                                     double resolution = 1e-8);
+
+// Content-addressed store of unweighted per-atom Betti feature rows, shared by the threads of the
+// feature loop and optionally kept on disk between runs
+class FeatureCache {
+public:
+    [[nodiscard]] std::optional<Eigen::VectorXd> find(const EnvironmentKey& key) const;
+    void insert(const EnvironmentKey& key, const Eigen::VectorXd& features);
+
+    [[nodiscard]] size_t size() const;
+    [[nodiscard]] size_t hits() const { return hits_.load(); }
+    [[nodiscard]] size_t misses() const { return misses_.load(); }
+
+    void save(const std::string& filepath) const;
+    void load(const std::string& filepath);
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<EnvironmentKey, Eigen::VectorXd, EnvironmentKeyHash> entries_;
+
+    mutable std::atomic<size_t> hits_{0};
+    mutable std::atomic<size_t> misses_{0};
+};
+
+}  // namespace defect_gnn::topology
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace defect_gnn::topology {
+
+// Packed file holding the Betti feature matrices of many structures. Layout (native byte order):
+//   header   magic "DGNNPACK", uint32 version, uint32 cols, uint64 structure count,
+//            uint64 index offset, uint64 id table offset, padded to 64 bytes
+//   payloads one column-major rows x cols double matrix per structure, each starting on a
+//            64-byte boundary
+//   index    per structure: uint64 payload offset, uint64 rows, uint64 id offset, uint64 id length
+//   id table the structure ids, concatenated
+constexpr size_t FEATURE_DATASET_ALIGNMENT = 64;
+
+// Streams matrices into a packed file. Nothing is visible at `filepath` until finish(), which
+// writes the index and moves the file into place.
+class FeatureDatasetWriter {
+public:
+    explicit FeatureDatasetWriter(std::string filepath);
+
+    void add(const std::string& id, const Eigen::MatrixXd& features);
+    void finish();
+
+private:
+    struct Entry {
+        uint64_t offset;
+        uint64_t rows;
+        uint64_t id_offset;
+        uint64_t id_length;
+    };
+
+    std::string filepath_;
+    std::string temp_path_;
+    std::ofstream file_;
+    std::vector<Entry> entries_;
+    std::string id_table_;
+    uint64_t cols_ = 0;
+    uint64_t end_ = 0;
+};
+
+using FeatureView = Eigen::Map<const Eigen::MatrixXd, Eigen::Aligned64>;
+
+// Read-only memory map of a packed file. Opening validates the header and index and builds the id
+// lookup; the matrices are views into the mapping and are only paged in when read.
+class FeatureDataset {
+public:
+    explicit FeatureDataset(const std::string& filepath);
+    ~FeatureDataset();
+
+    FeatureDataset(const FeatureDataset&) = delete;
+    FeatureDataset& operator=(const FeatureDataset&) = delete;
+
+    [[nodiscard]] size_t size() const { return num_structures_; }
+    [[nodiscard]] Eigen::Index cols() const { return cols_; }
+
+    [[nodiscard]] std::string_view id(size_t i) const;
+    [[nodiscard]] std::optional<size_t> find(std::string_view id) const;
+
+    [[nodiscard]] FeatureView features(size_t i) const;
+    [[nodiscard]] FeatureView features(std::string_view id) const;  // throws for unknown ids
+
+private:
+    struct Entry {
+        uint64_t offset;
+        uint64_t rows;
+        uint64_t id_offset;
+        uint64_t id_length;
+    };
+
+    [[nodiscard]] Entry entry(size_t i) const;
+
+    std::string filepath_;
+    const char* data_ = nullptr;
+    size_t file_size_ = 0;
+
+    size_t num_structures_ = 0;
+    Eigen::Index cols_ = 0;
+    const char* index_ = nullptr;
+    const char* id_table_ = nullptr;
+    std::unordered_map<std::string_view, size_t> lookup_;
+};
+
+}  // namespace defect_gnn::topology
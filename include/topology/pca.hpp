@@ -1,15 +1,46 @@
 #pragma once
 
+#include "utils/exact_sum.hpp"
+
 #include <Eigen/Dense>
 
 #include <string>
+#include <vector>
 
 namespace defect_gnn::topology {
 
+// Row count, column sums and sums of column products of a batch: everything the streaming fit
+// keeps of it. The sums are exact, so combining moments is associative and commutative.
+struct PCAMoments {
+    size_t count = 0;
+    std::vector<utils::ExactSum> sums;      // one per column
+    std::vector<utils::ExactSum> products;  // one per column pair i <= j, row by row
+
+    // Adds the other batch's rows; throws if the column counts differ
+    void merge(const PCAMoments& other);
+};
+
+[[nodiscard]] PCAMoments compute_moments(const Eigen::MatrixXd& x);
+
+// Three f64 arrays: the row count (1 x 1), then the partials of the sums and of the products, one
+// row per sum, zero-padded to the longest
+void save_moments(const std::string& filepath, const PCAMoments& moments);
+[[nodiscard]] PCAMoments load_moments(const std::string& filepath);
+
 class PCA {
 public:
     void fit(const Eigen::MatrixXd& x, int n_components = 6);
 
+    // Streaming fit: partial_fit accumulates the exact moments of each batch, finalize solves for
+    // the components. Memory and finalize cost do not depend on the row count. The same rows give
+    // the same model bit for bit, however they were split into batches, shards or merge orders.
+    void partial_fit(const Eigen::MatrixXd& x);
+    void merge(const PCAMoments& moments);
+    void finalize(int n_components = 6);
+    [[nodiscard]] size_t num_samples() const { return moments_.count; }
+    // Everything merged so far, for combining with other partial fits
+    [[nodiscard]] const PCAMoments& moments() const { return moments_; }
+
     [[nodiscard]] Eigen::MatrixXd transform(const Eigen::MatrixXd& x) const;
 
     Eigen::MatrixXd fit_transform(const Eigen::MatrixXd& x, int n_components = 6);
@@ -27,6 +58,8 @@ public:
 private:
     bool fitted_ = false;
 
+    PCAMoments moments_;
+
     int n_components_ = 0;
 
     Eigen::VectorXd mean_;
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "graph/neighbor_list.hpp"
+
 #include <Eigen/Dense>
 
+#include <atomic>
+#include <cstddef>
 #include <vector>
 
 namespace defect_gnn::topology {
@@ -21,8 +25,41 @@ struct PersistenceResult {
     PersistenceDiagram dim0;
     PersistenceDiagram dim1;
     PersistenceDiagram dim2;
+
+    // Edges within the threshold, and how many of them the edge collapse removed
+    size_t num_edges = 0;
+    size_t num_collapsed_edges = 0;
+
+    // Points kept by the landmark approximation (all of them when exact), and the distance within
+    // which every dropped point has a landmark
+    size_t num_landmarks = 0;
+    double cover_radius = 0.0;
+};
+
+// Edge counts summed over many calls, possibly from several threads
+struct CollapseCounters {
+    std::atomic<size_t> edges{0};
+    std::atomic<size_t> collapsed{0};
 };
 
+struct PersistenceOptions {
+    // Remove edges that stay dominated over the whole filtration before reduction. The diagrams
+    // are unchanged; only the order of the pairs may differ.
+    bool collapse_edges = false;
+    CollapseCounters* counters = nullptr;
+
+    // When positive, only a greedy-permutation subsample covering every point within this radius
+    // (Angstrom) enters the filtration. Below the threshold the diagrams then lie within
+    // bottleneck distance 2 * cover_radius <= 2 * landmark_radius of the exact ones. That bound
+    // does not carry over to the Betti features: their pair counts, means, spreads and weighted
+    // sums can change by as much as the features themselves, so the error is unbounded and must
+    // be measured with validate_approx before a radius is used.
+    double landmark_radius = 0.0;
+};
+
+// With num_threads == 1 Ripser runs on the calling thread, without worker threads or a parallel
+// sort, and reuses that thread's binomial table, pivot map and column buffers between calls.
+// This is the mode for the many small per-atom problems.
 PersistenceResult compute_persistence_from_distances(const Eigen::MatrixXd& distance_matrix,
                                                      double threshold,
                                                      unsigned num_threads);
@@ -30,4 +67,18 @@ PersistenceResult compute_persistence_from_distances(const Eigen::MatrixXd& dist
 PersistenceResult
 compute_persistence(const Eigen::MatrixXd& point_cloud, double threshold, unsigned num_threads);
 
+// Persistence of one atom's neighborhood: the center at the origin plus its neighbors at their
+// displacements. Ripser's sparse matrix is filled directly from the pairs within the threshold,
+// without a dense distance matrix.
+PersistenceResult compute_neighborhood_persistence(const graph::NeighborView<double>& neighbors,
+                                                   double threshold,
+                                                   unsigned num_threads,
+                                                   const PersistenceOptions& options = {});
+
+// Relative cost of compute_neighborhood_persistence, for scheduling: n * k^2 over the n points of
+// the neighborhood with mean degree k within the threshold. A dense neighborhood scales like n^3,
+// the growth of its dim-2 reduction; a sparse one of the same size is far cheaper.
+[[nodiscard]] double estimate_persistence_cost(const graph::NeighborView<double>& neighbors,
+                                               double threshold);
+
 }  // namespace defect_gnn::topology
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace defect_gnn::utils {
+
+// Sum of finite doubles held without rounding, as non-overlapping partials in increasing magnitude
+// (Shewchuk's expansion, as in Python's math.fsum). Adding values or other sums in any order and
+// grouping keeps the same exact value, and value() rounds it once, correctly, so the result does
+// not depend on how the terms were split or ordered.
+class ExactSum {
+public:
+    void add(double x) {
+        size_t kept = 0;
+        for (double y : partials_) {
+            if (std::abs(x) < std::abs(y)) {
+                std::swap(x, y);
+            }
+            double hi = x + y;
+            double lo = y - (hi - x);
+            if (lo != 0.0) {
+                partials_[kept++] = lo;
+            }
+            x = hi;
+        }
+        partials_.resize(kept);
+        partials_.push_back(x);
+    }
+
+    void add(const ExactSum& other) {
+        for (double partial : other.partials_) {
+            add(partial);
+        }
+    }
+
+    // a * b is exactly the rounded product plus the error fma recovers
+    void add_product(double a, double b) {
+        double product = a * b;
+        add(std::fma(a, b, -product));
+        add(product);
+    }
+
+    // The exact sum rounded to nearest, ties to even
+    [[nodiscard]] double value() const {
+        size_t n = partials_.size();
+        if (n == 0) {
+            return 0.0;
+        }
+
+        double hi = partials_[--n];
+        double lo = 0.0;
+        while (n > 0) {
+            double x = hi;
+            double y = partials_[--n];
+            hi = x + y;
+            lo = y - (hi - x);
+            if (lo != 0.0) {
+                break;
+            }
+        }
+
+        // If hi + lo was a tie, the sign of the partials below lo breaks it
+        if (n > 0 &&
+            ((lo < 0.0 && partials_[n - 1] < 0.0) || (lo > 0.0 && partials_[n - 1] > 0.0))) {
+            double y = lo * 2.0;
+            double x = hi + y;
+            if (y == x - hi) {
+                hi = x;
+            }
+        }
+        return hi;
+    }
+
+    [[nodiscard]] const std::vector<double>& partials() const { return partials_; }
+
+private:
+    std::vector<double> partials_;
+};
+
+}  // namespace defect_gnn::utils
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace defect_gnn::utils {
+
+constexpr uint64_t FNV1A_64_OFFSET = 0xCBF29CE484222325ULL;
+
+// 64-bit FNV-1a; pass a previous result as `hash` to continue over more bytes
+[[nodiscard]] inline uint64_t fnv1a_64(std::string_view bytes, uint64_t hash = FNV1A_64_OFFSET) {
+    for (char c : bytes) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// fnv1a_64 over the whole file
+[[nodiscard]] inline uint64_t hash_file(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for reading: " + filepath);
+    }
+
+    std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return fnv1a_64(bytes);
+}
+
+}  // namespace defect_gnn::utils
@@ -6,24 +6,31 @@
 
 namespace defect_gnn::utils {
 
-inline double mean(const Eigen::VectorXd& v) {
+// Reductions over any dense vector expression, including Maps over scratch buffers
+
+template <typename Derived>
+inline double mean(const Eigen::MatrixBase<Derived>& v) {
     return v.mean();
 }
 
-inline double std(const Eigen::VectorXd& v) {
+template <typename Derived>
+inline double std(const Eigen::MatrixBase<Derived>& v) {
     double m = v.mean();
     return std::sqrt((v.array() - m).square().mean());
 }
 
-inline double max(const Eigen::VectorXd& v) {
+template <typename Derived>
+inline double max(const Eigen::MatrixBase<Derived>& v) {
     return v.maxCoeff();
 }
 
-inline double min(const Eigen::VectorXd& v) {
+template <typename Derived>
+inline double min(const Eigen::MatrixBase<Derived>& v) {
     return v.minCoeff();
 }
 
-inline double weighted_sum(const Eigen::VectorXd& v, double weight) {
+template <typename Derived>
+inline double weighted_sum(const Eigen::MatrixBase<Derived>& v, double weight) {
     return v.sum() * weight;
 }
 
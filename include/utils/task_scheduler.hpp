@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace defect_gnn::utils {
+
+// Work-stealing pool for independent tasks of very different, roughly known cost. Every worker
+// keeps its own deque sorted by decreasing cost and takes the most expensive item it can; an idle
+// worker steals from the others the same way, so pending work drains longest-first across every
+// batch in flight. Heavy tasks are additionally capped at `max_heavy` running at once: a worker
+// that cannot start a heavy task picks the cheapest light one instead, or waits. One lock guards
+// all deques; tasks run for milliseconds, so taking it per task is cheap.
+class TaskScheduler {
+public:
+    struct Task {
+        double cost = 0.0;
+        bool heavy = false;
+        std::function<void()> run;
+    };
+
+    TaskScheduler(unsigned num_workers, unsigned max_heavy)
+        : queues_(std::max(1U, num_workers)), max_heavy_(std::max(1U, max_heavy)) {
+        for (size_t w = 0; w < queues_.size(); w++) {
+            workers_.emplace_back([this, w] { work(w); });
+        }
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    ~TaskScheduler() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    [[nodiscard]] size_t num_workers() const { return workers_.size(); }
+
+    // Runs the tasks on the pool and returns once all of them finished, rethrowing the first
+    // exception any of them raised. Safe to call from several threads at once; must not be
+    // called from inside a task.
+    void run_batch(std::vector<Task> tasks) {
+        if (tasks.empty()) {
+            return;
+        }
+
+        auto batch = std::make_shared<Batch>();
+        batch->remaining = tasks.size();
+
+        std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) {
+            return a.cost > b.cost;
+        });
+
+        {
+            std::lock_guard lock(mutex_);
+            // Dealt round-robin from the most expensive so every worker starts on a long task
+            for (size_t t = 0; t < tasks.size(); t++) {
+                std::deque<Item>& queue = queues_[(next_queue_ + t) % queues_.size()];
+                Item item{std::move(tasks[t]), batch};
+                auto pos = std::find_if(queue.begin(), queue.end(), [&](const Item& queued) {
+                    return queued.task.cost < item.task.cost;
+                });
+                queue.insert(pos, std::move(item));
+            }
+            next_queue_ = (next_queue_ + tasks.size()) % queues_.size();
+        }
+        wake_.notify_all();
+
+        std::unique_lock lock(batch->mutex);
+        batch->done.wait(lock, [&] { return batch->remaining == 0; });
+        if (batch->error) {
+            std::rethrow_exception(batch->error);
+        }
+    }
+
+private:
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = 0;
+        std::exception_ptr error;
+    };
+
+    struct Item {
+        Task task;
+        std::shared_ptr<Batch> batch;
+    };
+
+    // Caller holds mutex_. Own queue first, then the others starting from the next worker.
+    std::optional<Item> take(size_t self) {
+        for (size_t k = 0; k < queues_.size(); k++) {
+            std::deque<Item>& queue = queues_[(self + k) % queues_.size()];
+            if (queue.empty()) {
+                continue;
+            }
+            if (!queue.front().task.heavy || running_heavy_ < max_heavy_) {
+                Item item = std::move(queue.front());
+                queue.pop_front();
+                return item;
+            }
+            if (!queue.back().task.heavy) {
+                Item item = std::move(queue.back());
+                queue.pop_back();
+                return item;
+            }
+        }
+        return std::nullopt;
+    }
+
+    void work(size_t self) {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            std::optional<Item> item;
+            wake_.wait(lock, [&] { return stopping_ || (item = take(self)).has_value(); });
+            if (!item) {
+                return;
+            }
+
+            const bool heavy = item->task.heavy;
+            if (heavy) {
+                running_heavy_++;
+            }
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                item->task.run();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            finish(*item->batch, error);
+
+            lock.lock();
+            if (heavy) {
+                running_heavy_--;
+                wake_.notify_all();  // a worker may be waiting for the heavy slot
+            }
+        }
+    }
+
+    static void finish(Batch& batch, const std::exception_ptr& error) {
+        std::lock_guard lock(batch.mutex);
+        if (error && !batch.error) {
+            batch.error = error;
+        }
+        if (--batch.remaining == 0) {
+            batch.done.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<std::deque<Item>> queues_;
+    std::vector<std::thread> workers_;
+    size_t next_queue_ = 0;
+    unsigned max_heavy_;
+    unsigned running_heavy_ = 0;
+    bool stopping_ = false;
+};
+
+}  // namespace defect_gnn::utils
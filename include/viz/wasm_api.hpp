@@ -35,6 +35,8 @@ public:
 private:
     std::unique_ptr<io::VASPStructure> vasp_;
     std::unique_ptr<crystal::Structure> structure_;
+    // Built once at the largest slider settings; neighbors_ is filtered from it on each change
+    std::unique_ptr<graph::NeighborList> superset_;
     std::unique_ptr<graph::NeighborList> neighbors_;
 };
 
@@ -2,20 +2,56 @@
 
 #include "io/vasp_parser.hpp"
 
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <span>
+#include <vector>
+
 namespace defect_gnn::crystal {
 
+namespace {
+
+// Columns per tile in the distance kernels; the wrapped fractional deltas of one tile stay in
+// stack buffers so the rounding is done once per pair
+constexpr int DISTANCE_TILE = 64;
+
+using TileArray = Eigen::Array<double, Eigen::Dynamic, 1, Eigen::ColMajor, DISTANCE_TILE, 1>;
+
+// std::round (halves away from zero) in packet form: truncating through int32 and correcting by
+// the exact remainder vectorizes without SSE4.1, unlike Eigen's round(). Deltas between fractional
+// coordinates are far inside the int32 range.
+TileArray round_half_away(const TileArray& x) {
+    TileArray truncated = x.cast<int>().cast<double>();
+    TileArray remainder = x - truncated;
+    TileArray ones = TileArray::Ones(x.size());
+
+    return truncated + (remainder >= 0.5).select(ones, 0.0) - (remainder <= -0.5).select(ones, 0.0);
+}
+
+}  // namespace
+
 Structure::Structure(const io::VASPStructure& vasp)
-    : lattice_(vasp.lattice), inv_lattice_(vasp.lattice.inverse()) {
-    for (size_t elem_idx = 0; elem_idx < vasp.counts.size(); elem_idx++) {
-        counts_[static_cast<int>(elem_idx)] = vasp.counts[elem_idx];
+    : lattice_(vasp.lattice), inv_lattice_(vasp.lattice.inverse()), counts_(vasp.counts) {
+    auto atom_count = static_cast<size_t>(vasp.frac_coords.rows());
+
+    elements_.assign(vasp.atom_types.begin(), vasp.atom_types.begin() + atom_count);
+    for (auto* coords : {&x_, &y_, &z_, &frac_x_, &frac_y_, &frac_z_}) {
+        coords->resize(atom_count);
     }
 
-    for (int i = 0; i < vasp.frac_coords.rows(); i++) {
-        Atom atom;
-        atom.element = vasp.atom_types[i];
-        atom.frac_position = vasp.frac_coords.row(i);
-        atom.position = lattice_.transpose() * atom.frac_position;
-        atoms_.push_back(atom);
+    for (size_t i = 0; i < atom_count; i++) {
+        Eigen::Vector3d frac_position = vasp.frac_coords.row(static_cast<Eigen::Index>(i));
+        Eigen::Vector3d position = lattice_.transpose() * frac_position;
+
+        frac_x_[i] = frac_position.x();
+        frac_y_[i] = frac_position.y();
+        frac_z_[i] = frac_position.z();
+        x_[i] = position.x();
+        y_[i] = position.y();
+        z_[i] = position.z();
     }
 }
 
@@ -23,12 +59,8 @@ const Eigen::Matrix3d& Structure::lattice() const {
     return lattice_;
 }
 
-const std::vector<Atom>& Structure::atoms() const {
-    return atoms_;
-}
-
 size_t Structure::num_atoms() const {
-    return atoms_.size();
+    return elements_.size();
 }
 
 double Structure::distance(size_t i, size_t j) const {
@@ -36,7 +68,7 @@ double Structure::distance(size_t i, size_t j) const {
 }
 
 Eigen::Vector3d Structure::displacement(size_t i, size_t j) const {
-    Eigen::Vector3d delta_frac = atoms_[j].frac_position - atoms_[i].frac_position;
+    Eigen::Vector3d delta_frac = frac_position(j) - frac_position(i);
 
     for (int k = 0; k < 3; k++) {
         delta_frac[k] -= std::round(delta_frac[k]);
@@ -45,24 +77,130 @@ Eigen::Vector3d Structure::displacement(size_t i, size_t j) const {
     return lattice_.transpose() * delta_frac;
 }
 
+// Same arithmetic as distance(i, j), in the same order, evaluated for atoms [begin, end) at once
+template <typename Real>
+void Structure::distance_tile(size_t i, size_t begin, size_t end, Real* out) const {
+    auto n = static_cast<Eigen::Index>(end - begin);
+    auto segment = [&](const std::vector<double>& coords) {
+        return Eigen::Map<const Eigen::ArrayXd>(coords.data() + begin, n);
+    };
+
+    TileArray dfx = segment(frac_x_) - frac_x_[i];
+    TileArray dfy = segment(frac_y_) - frac_y_[i];
+    TileArray dfz = segment(frac_z_) - frac_z_[i];
+    dfx -= round_half_away(dfx);
+    dfy -= round_half_away(dfy);
+    dfz -= round_half_away(dfz);
+
+    TileArray dx = lattice_(0, 0) * dfx + lattice_(1, 0) * dfy + lattice_(2, 0) * dfz;
+    TileArray dy = lattice_(0, 1) * dfx + lattice_(1, 1) * dfy + lattice_(2, 1) * dfz;
+    TileArray dz = lattice_(0, 2) * dfx + lattice_(1, 2) * dfy + lattice_(2, 2) * dfz;
+
+    Eigen::Map<Eigen::Array<Real, Eigen::Dynamic, 1>>(out, n) =
+        (dx * dx + dy * dy + dz * dz).sqrt().template cast<Real>();
+}
+
+void Structure::distances_from(size_t i, std::span<double> out) const {
+    for (size_t begin = 0; begin < num_atoms(); begin += DISTANCE_TILE) {
+        size_t end = std::min(num_atoms(), begin + DISTANCE_TILE);
+        distance_tile(i, begin, end, out.data() + begin);
+    }
+}
+
+void Structure::distances_from(size_t i, std::span<float> out) const {
+    for (size_t begin = 0; begin < num_atoms(); begin += DISTANCE_TILE) {
+        size_t end = std::min(num_atoms(), begin + DISTANCE_TILE);
+        distance_tile(i, begin, end, out.data() + begin);
+    }
+}
+
 int Structure::count(int element) const {
-    return counts_.at(element);
+    return counts_.at(static_cast<size_t>(element));
 }
 
+// The minimum-image distance is exactly symmetric, so column j (contiguous in Eigen's
+// column-major layout) is filled with the distances from atom j
 Eigen::MatrixXd Structure::compute_distance_matrix() const {
-    auto N = static_cast<Eigen::Index>(atoms_.size());
+    auto N = static_cast<Eigen::Index>(num_atoms());
     Eigen::MatrixXd distances(N, N);
 
-    for (Eigen::Index i = 0; i < N; i++) {
-        distances(i, i) = 0.0;
-        for (Eigen::Index j = i + 1; j < N; j++) {
-            double d = distance(static_cast<size_t>(i), static_cast<size_t>(j));
-            distances(i, j) = d;
-            distances(j, i) = d;
-        }
+    for (Eigen::Index j = 0; j < N; j++) {
+        distances_from(static_cast<size_t>(j), std::span(distances.col(j).data(), num_atoms()));
     }
 
     return distances;
 }
 
-}  // namespace defect_gnn::crystal
\ No newline at end of file
+Eigen::MatrixXf Structure::compute_distance_matrix_f32() const {
+    auto N = static_cast<Eigen::Index>(num_atoms());
+    Eigen::MatrixXf distances(N, N);
+
+    for (Eigen::Index j = 0; j < N; j++) {
+        distances_from(static_cast<size_t>(j), std::span(distances.col(j).data(), num_atoms()));
+    }
+
+    return distances;
+}
+
+// Every host atom of the same element as vacancy atom 0 proposes a translation. A proposal is
+// accepted when each vacancy atom lands, modulo the lattice, on a distinct host atom of its
+// element; the single host atom left over is the vacancy.
+std::optional<VacancyMap>
+match_vacancy(const Structure& host, const Structure& vacancy, double tolerance) {
+    const size_t num_host = host.num_atoms();
+    const size_t num_vacancy = vacancy.num_atoms();
+
+    if (num_vacancy == 0 || num_vacancy + 1 != num_host ||
+        !host.lattice().isApprox(vacancy.lattice(), 1e-9)) {
+        return std::nullopt;
+    }
+
+    const Eigen::Matrix3d lattice_t = host.lattice().transpose();
+    const double tolerance_sq = tolerance * tolerance;
+
+    auto same_site = [&](const Eigen::Vector3d& a, const Eigen::Vector3d& b) {
+        Eigen::Vector3d delta_frac = a - b;
+        for (int k = 0; k < 3; k++) {
+            delta_frac[k] -= std::round(delta_frac[k]);
+        }
+        return (lattice_t * delta_frac).squaredNorm() < tolerance_sq;
+    };
+
+    std::vector<bool> used(num_host);
+
+    for (size_t anchor = 0; anchor < num_host; anchor++) {
+        if (host.element(anchor) != vacancy.element(0)) {
+            continue;
+        }
+
+        Eigen::Vector3d shift = host.frac_position(anchor) - vacancy.frac_position(0);
+        VacancyMap map{0, std::vector<size_t>(num_vacancy)};
+        std::fill(used.begin(), used.end(), false);
+
+        bool matched = true;
+        for (size_t i = 0; i < num_vacancy && matched; i++) {
+            Eigen::Vector3d target = vacancy.frac_position(i) + shift;
+            matched = false;
+
+            for (size_t h = 0; h < num_host; h++) {
+                if (!used[h] && host.element(h) == vacancy.element(i) &&
+                    same_site(host.frac_position(h), target)) {
+                    used[h] = true;
+                    map.host_index[i] = h;
+                    matched = true;
+                    break;
+                }
+            }
+        }
+
+        if (matched) {
+            auto left_over = std::find(used.begin(), used.end(), false);
+            map.removed = static_cast<size_t>(left_over - used.begin());
+            return map;
+        }
+    }
+
+    return std::nullopt;
+}
+
+}  // namespace defect_gnn::crystal
@@ -0,0 +1,221 @@
+#include "crystal/symmetry.hpp"
+
+#include "crystal/structure.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace defect_gnn::crystal {
+
+namespace {
+
+constexpr size_t NOT_FOUND = std::numeric_limits<size_t>::max();
+
+// Periodic grid over wrapped fractional coordinates for finding the atom at a site in O(1).
+// Cells are much wider than the tolerance, so a site is always in the 3x3x3 block around its cell.
+class SiteLookup {
+public:
+    SiteLookup(const Structure& structure, double tolerance)
+        : structure_(structure),
+          lattice_t_(structure.lattice().transpose()),
+          tolerance_sq_(tolerance * tolerance),
+          grid_(std::max(1, static_cast<int>(std::cbrt(structure.num_atoms())))),
+          cell_start_(static_cast<size_t>(grid_ * grid_ * grid_) + 1, 0),
+          cell_atoms_(structure.num_atoms()) {
+        std::vector<size_t> atom_cell(structure.num_atoms());
+        for (size_t i = 0; i < structure.num_atoms(); i++) {
+            atom_cell[i] = flat_cell(cell_of(structure.frac_position(i)));
+            cell_start_[atom_cell[i] + 1]++;
+        }
+
+        std::partial_sum(cell_start_.begin(), cell_start_.end(), cell_start_.begin());
+
+        std::vector<size_t> fill(cell_start_.begin(), cell_start_.end() - 1);
+        for (size_t i = 0; i < structure.num_atoms(); i++) {
+            cell_atoms_[fill[atom_cell[i]]++] = i;
+        }
+    }
+
+    // Atom of `element` within tolerance of the fractional site, or NOT_FOUND
+    [[nodiscard]] size_t find(const Eigen::Vector3d& frac, int element) const {
+        std::array<int, 3> cell = cell_of(frac);
+
+        for (int o_a = -1; o_a <= 1; o_a++) {
+            for (int o_b = -1; o_b <= 1; o_b++) {
+                for (int o_c = -1; o_c <= 1; o_c++) {
+                    size_t c = flat_cell({cell[0] + o_a, cell[1] + o_b, cell[2] + o_c});
+
+                    for (size_t slot = cell_start_[c]; slot < cell_start_[c + 1]; slot++) {
+                        size_t j = cell_atoms_[slot];
+                        if (structure_.element(j) == element && same_site(frac, j)) {
+                            return j;
+                        }
+                    }
+                }
+            }
+        }
+
+        return NOT_FOUND;
+    }
+
+private:
+    [[nodiscard]] std::array<int, 3> cell_of(const Eigen::Vector3d& frac) const {
+        std::array<int, 3> cell{};
+        for (int k = 0; k < 3; k++) {
+            double wrapped = frac[k] - std::floor(frac[k]);
+            cell[k] = std::min(static_cast<int>(wrapped * grid_), grid_ - 1);
+        }
+        return cell;
+    }
+
+    [[nodiscard]] size_t flat_cell(std::array<int, 3> cell) const {
+        for (int& c : cell) {
+            c = (c % grid_ + grid_) % grid_;
+        }
+        return static_cast<size_t>((cell[0] * grid_ + cell[1]) * grid_ + cell[2]);
+    }
+
+    [[nodiscard]] bool same_site(const Eigen::Vector3d& frac, size_t j) const {
+        Eigen::Vector3d delta_frac = structure_.frac_position(j) - frac;
+        for (int k = 0; k < 3; k++) {
+            delta_frac[k] -= std::round(delta_frac[k]);
+        }
+        return (lattice_t_ * delta_frac).squaredNorm() < tolerance_sq_;
+    }
+
+    const Structure& structure_;
+    Eigen::Matrix3d lattice_t_;
+    double tolerance_sq_;
+    int grid_;
+    std::vector<size_t> cell_start_;
+    std::vector<size_t> cell_atoms_;
+};
+
+// Integer matrices with entries in {-1, 0, 1} and determinant +-1 that preserve the metric
+// G = L L^T, i.e. map the lattice onto itself without changing lengths or angles
+std::vector<Eigen::Matrix3i> lattice_rotations(const Eigen::Matrix3d& lattice, double tolerance) {
+    Eigen::Matrix3d metric = lattice * lattice.transpose();
+    double max_length = std::sqrt(metric.diagonal().maxCoeff());
+
+    // First-order change of a squared length when the vector moves by `tolerance`
+    double metric_tolerance = 2.0 * tolerance * max_length;
+
+    std::vector<Eigen::Matrix3i> rotations;
+    Eigen::Matrix3i w;
+
+    for (int code = 0; code < 19683; code++) {  // 3^9 matrices
+        int rest = code;
+        for (int k = 0; k < 9; k++) {
+            w(k / 3, k % 3) = rest % 3 - 1;
+            rest /= 3;
+        }
+
+        if (std::abs(w.determinant()) != 1) {
+            continue;
+        }
+
+        Eigen::Matrix3d w_d = w.cast<double>();
+        if ((w_d.transpose() * metric * w_d - metric).cwiseAbs().maxCoeff() <= metric_tolerance) {
+            rotations.push_back(w);
+        }
+    }
+
+    return rotations;
+}
+
+size_t find_root(std::vector<size_t>& parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+}  // namespace
+
+// Each metric-preserving rotation is tried with the translations that carry one anchor atom of
+// the rarest element onto another atom of that element; a translation is kept when every atom
+// lands on an atom of its own element.
+std::vector<SymmetryOperation> find_symmetry_operations(const Structure& structure,
+                                                        double tolerance) {
+    const size_t num_atoms = structure.num_atoms();
+    if (num_atoms == 0) {
+        return {};
+    }
+
+    std::vector<size_t> element_count;
+    for (int element : structure.elements()) {
+        element_count.resize(std::max(element_count.size(), static_cast<size_t>(element) + 1));
+        element_count[static_cast<size_t>(element)]++;
+    }
+
+    size_t anchor = 0;
+    for (size_t i = 1; i < num_atoms; i++) {
+        if (element_count[static_cast<size_t>(structure.element(i))] <
+            element_count[static_cast<size_t>(structure.element(anchor))]) {
+            anchor = i;
+        }
+    }
+
+    SiteLookup lookup(structure, tolerance);
+    std::vector<SymmetryOperation> operations;
+    std::vector<size_t> permutation(num_atoms);
+
+    for (const Eigen::Matrix3i& rotation : lattice_rotations(structure.lattice(), tolerance)) {
+        Eigen::Matrix3d rotation_d = rotation.cast<double>();
+        Eigen::Vector3d rotated_anchor = rotation_d * structure.frac_position(anchor);
+
+        for (size_t target = 0; target < num_atoms; target++) {
+            if (structure.element(target) != structure.element(anchor)) {
+                continue;
+            }
+
+            Eigen::Vector3d translation = structure.frac_position(target) - rotated_anchor;
+            translation -= translation.array().floor().matrix();
+
+            bool valid = true;
+            for (size_t i = 0; i < num_atoms && valid; i++) {
+                Eigen::Vector3d site = rotation_d * structure.frac_position(i) + translation;
+                permutation[i] = lookup.find(site, structure.element(i));
+                valid = permutation[i] != NOT_FOUND;
+            }
+
+            if (valid) {
+                operations.push_back({rotation, translation, permutation});
+            }
+        }
+    }
+
+    return operations;
+}
+
+std::vector<size_t> find_equivalent_atoms(const Structure& structure, double tolerance) {
+    std::vector<size_t> parent(structure.num_atoms());
+    std::iota(parent.begin(), parent.end(), 0);
+
+    for (const SymmetryOperation& op : find_symmetry_operations(structure, tolerance)) {
+        for (size_t i = 0; i < parent.size(); i++) {
+            size_t a = find_root(parent, i);
+            size_t b = find_root(parent, op.permutation[i]);
+            if (a != b) {
+                parent[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+
+    // Roots are the smallest index of each orbit since merges always point to the smaller root
+    std::vector<size_t> orbit(parent.size());
+    for (size_t i = 0; i < parent.size(); i++) {
+        orbit[i] = find_root(parent, i);
+    }
+
+    return orbit;
+}
+
+}  // namespace defect_gnn::crystal
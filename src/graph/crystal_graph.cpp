@@ -17,25 +17,23 @@ CrystalGraph::CrystalGraph(const crystal::Structure& structure,
     node_features_.resize(num_atoms, atom_embedding_dims);
 
     for (int i = 0; i < num_atoms; i++) {
-        node_features_.row(i) = atom_embeddings.at(structure.atoms()[i].element);
+        node_features_.row(i) = atom_embeddings.at(structure.element(static_cast<size_t>(i)));
     }
 
-    int edge_count = 0;
-    for (int i = 0; i < num_atoms; i++) {
-        edge_count += static_cast<int>(neighbors.neighbors(i).size());
-    }
+    const NeighborTable<double>& table = neighbors.table();
+    int edge_count = static_cast<int>(table.num_edges());
 
     edge_index_.resize(2, edge_count);
     int n_rbf = static_cast<int>(std::floor(r_cutoff / dr));
     edge_attr_.resize(edge_count, n_rbf);
 
-    int edge = 0;
     for (int i = 0; i < num_atoms; i++) {
-        for (const Neighbor& neighbor : neighbors.neighbors(i)) {
-            edge_index_(0, edge) = i;
-            edge_index_(1, edge) = static_cast<int>(neighbor.idx);
-            edge_attr_.row(edge) = defect_gnn::graph::gaussian_rbf(neighbor.distance, r_cutoff, dr);
-            edge++;
+        for (size_t edge = table.offsets[i]; edge < table.offsets[i + 1]; edge++) {
+            auto e = static_cast<Eigen::Index>(edge);
+            edge_index_(0, e) = i;
+            edge_index_(1, e) = static_cast<int>(table.indices[edge]);
+            edge_attr_.row(e) =
+                defect_gnn::graph::gaussian_rbf(table.distances[edge], r_cutoff, dr);
         }
     }
 
@@ -5,92 +5,581 @@
 #include <Eigen/Dense>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstddef>
+#include <limits>
 #include <nanoflann.hpp>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <tuple>
 #include <vector>
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 namespace defect_gnn::graph {
 
+namespace {
+
+// Total order on neighbors: by distance, then index, then displacement. Periodic images of the
+// same atom can tie on distance, so the tie-breaks keep truncation deterministic across backends.
+bool closer(const Neighbor& a, const Neighbor& b) {
+    return std::tie(a.distance, a.idx, a.displacement.x(), a.displacement.y(), a.displacement.z()) <
+           std::tie(b.distance, b.idx, b.displacement.x(), b.displacement.y(), b.displacement.z());
+}
+
+Eigen::Vector3d image_offset(const Eigen::Matrix3d& lattice, int n_a, int n_b, int n_c) {
+    return (n_a * lattice.row(0) + n_b * lattice.row(1) + n_c * lattice.row(2)).transpose();
+}
+
+int floor_div(int a, int b) {
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Keeps the `capacity` closest candidates offered so far. While bounded it is a max-heap under
+// closer(), so the farthest kept neighbor sits at the front and is evicted in O(log k); the cost
+// of a query then scales with max_neighbors rather than with the matches inside the cutoff.
+// An unbounded heap just collects and sorts once at the end.
+class BoundedNeighborHeap {
+public:
+    void reset(size_t capacity) {
+        capacity_ = capacity;
+        items_.clear();
+    }
+
+    [[nodiscard]] bool full() const { return items_.size() >= capacity_; }
+
+    // Squared distance below which a candidate can still enter; ties with the current farthest
+    // kept neighbor pass too so closer() can break them.
+    [[nodiscard]] double admission_dist_sq(double radius_sq) const {
+        if (!full() || items_.empty()) {
+            return radius_sq;
+        }
+        double bound = std::nextafter(items_.front().distance, INFINITY);
+
+        return std::min(radius_sq, std::nextafter(bound * bound, INFINITY));
+    }
+
+    void offer(const Neighbor& candidate) {
+        if (capacity_ == std::numeric_limits<size_t>::max()) {
+            items_.push_back(candidate);
+            return;
+        }
+        if (capacity_ == 0) {
+            return;
+        }
+        if (!full()) {
+            items_.push_back(candidate);
+            std::push_heap(items_.begin(), items_.end(), closer);
+            return;
+        }
+        if (closer(candidate, items_.front())) {
+            std::pop_heap(items_.begin(), items_.end(), closer);
+            items_.back() = candidate;
+            std::push_heap(items_.begin(), items_.end(), closer);
+        }
+    }
+
+    // Kept neighbors in ascending closer() order; the heap must be reset before reuse
+    const std::vector<Neighbor>& sorted() {
+        if (capacity_ == std::numeric_limits<size_t>::max()) {
+            std::sort(items_.begin(), items_.end(), closer);
+        } else {
+            std::sort_heap(items_.begin(), items_.end(), closer);
+        }
+
+        return items_;
+    }
+
+private:
+    size_t capacity_ = 0;
+    std::vector<Neighbor> items_;
+};
+
+// nanoflann result set that feeds a BoundedNeighborHeap. worstDist() shrinks to the farthest kept
+// neighbor once the heap is full, which lets the KD-tree prune branches beyond it.
+template <class Cloud>
+class TopKResultSet {
+public:
+    using DistanceType = double;
+
+    TopKResultSet(BoundedNeighborHeap& heap,
+                  const Cloud& cloud,
+                  const Eigen::Vector3d& query_pt,
+                  size_t atom_idx,
+                  double epsilon,
+                  double radius_sq)
+        : heap_(heap),
+          cloud_(cloud),
+          query_pt_(query_pt),
+          atom_idx_(atom_idx),
+          epsilon_(epsilon),
+          radius_sq_(radius_sq),
+          worst_dist_sq_(radius_sq) {}
+
+    [[nodiscard]] bool full() const { return heap_.full(); }
+    // NOLINTNEXTLINE(readability-identifier-naming)
+    [[nodiscard]] double worstDist() const { return worst_dist_sq_; }
+
+    // NOLINTNEXTLINE(readability-identifier-naming)
+    bool addPoint(double dist_sq, unsigned int cloud_idx) {
+        size_t orig_idx = cloud_.original_index(cloud_idx);
+
+        if (orig_idx == atom_idx_ && std::sqrt(dist_sq) < epsilon_) {
+            return true;
+        }
+
+        heap_.offer(Neighbor(orig_idx, std::sqrt(dist_sq), cloud_.position(cloud_idx) - query_pt_));
+        worst_dist_sq_ = heap_.admission_dist_sq(radius_sq_);
+
+        return true;
+    }
+
+private:
+    BoundedNeighborHeap& heap_;
+    const Cloud& cloud_;
+    const Eigen::Vector3d& query_pt_;
+    size_t atom_idx_;
+    double epsilon_;
+    double radius_sq_;
+    double worst_dist_sq_;
+};
+
+// Atoms per parallel work item when building a table. Each chunk fills its own CSR buffer, and
+// the buffers are concatenated in chunk order, so the table is independent of the thread count.
+constexpr size_t ATOMS_PER_CHUNK = 64;
+
+void append_row(NeighborTable<double>& table, const std::vector<Neighbor>& neighbor_list) {
+    for (const Neighbor& neighbor : neighbor_list) {
+        table.indices.push_back(static_cast<uint32_t>(neighbor.idx));
+        table.distances.push_back(neighbor.distance);
+        table.dx.push_back(neighbor.displacement.x());
+        table.dy.push_back(neighbor.displacement.y());
+        table.dz.push_back(neighbor.displacement.z());
+    }
+    table.offsets.push_back(table.indices.size());
+}
+
+// OpenMP team size for a thread limit, where 0 leaves the count to OpenMP
+[[maybe_unused]] int team_size(unsigned num_threads) {
+#ifdef _OPENMP
+    return num_threads > 0 ? static_cast<int>(num_threads) : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// Runs query(i, heap) for every atom in query_atoms on up to num_threads threads and assembles the
+// sorted rows, in query_atoms order, into one table. The query must only read shared state.
+template <class Query>
+NeighborTable<double> gather_rows(std::span<const size_t> query_atoms,
+                                  size_t max_neighbors,
+                                  unsigned num_threads,
+                                  const Query& query) {
+    const size_t num_atoms = query_atoms.size();
+    const size_t num_chunks = (num_atoms + ATOMS_PER_CHUNK - 1) / ATOMS_PER_CHUNK;
+    std::vector<NeighborTable<double>> chunks(num_chunks);
+
+#pragma omp parallel num_threads(team_size(num_threads))
+    {
+        BoundedNeighborHeap heap;
+
+#pragma omp for schedule(dynamic)
+        for (size_t c = 0; c < num_chunks; c++) {
+            size_t end = std::min(num_atoms, (c + 1) * ATOMS_PER_CHUNK);
+
+            for (size_t q = c * ATOMS_PER_CHUNK; q < end; q++) {
+                heap.reset(max_neighbors);
+                query(query_atoms[q], heap);
+                append_row(chunks[c], heap.sorted());
+            }
+        }
+    }
+
+    NeighborTable<double> table;
+    size_t num_edges = 0;
+    for (const auto& chunk : chunks) {
+        num_edges += chunk.num_edges();
+    }
+
+    table.offsets.reserve(num_atoms + 1);
+    table.indices.reserve(num_edges);
+    table.distances.reserve(num_edges);
+    table.dx.reserve(num_edges);
+    table.dy.reserve(num_edges);
+    table.dz.reserve(num_edges);
+
+    for (const auto& chunk : chunks) {
+        size_t base = table.num_edges();
+
+        for (size_t k = 1; k < chunk.offsets.size(); k++) {
+            table.offsets.push_back(base + chunk.offsets[k]);
+        }
+        table.indices.insert(table.indices.end(), chunk.indices.begin(), chunk.indices.end());
+        table.distances.insert(
+            table.distances.end(), chunk.distances.begin(), chunk.distances.end());
+        table.dx.insert(table.dx.end(), chunk.dx.begin(), chunk.dx.end());
+        table.dy.insert(table.dy.end(), chunk.dy.begin(), chunk.dy.end());
+        table.dz.insert(table.dz.end(), chunk.dz.begin(), chunk.dz.end());
+    }
+
+    return table;
+}
+
+}  // namespace
+
 NeighborList::NeighborList(const crystal::Structure& structure,
                            double r_cutoff,  // NOLINT(bugprone-easily-swappable-parameters)
                            size_t max_neighbors,
-                           double epsilon)
-    : r_cutoff_(r_cutoff), max_neighbors_(max_neighbors), epsilon_(epsilon) {
-    neighbor_lists_.resize(structure.num_atoms());
-    build_with_pbc(structure);
+                           double epsilon,
+                           NeighborBackend backend,
+                           unsigned num_threads)
+    : NeighborList(r_cutoff, max_neighbors, epsilon, backend, num_threads) {
+    std::vector<size_t> all_atoms(structure.num_atoms());
+    std::iota(all_atoms.begin(), all_atoms.end(), 0);
+
+    table_ = search(structure, all_atoms, max_neighbors_);
 }
 
-const std::vector<Neighbor>& NeighborList::neighbors(size_t atom_idx) const {
-    return neighbor_lists_[atom_idx];
+NeighborList::NeighborList(double r_cutoff,
+                           size_t max_neighbors,
+                           double epsilon,
+                           NeighborBackend backend,
+                           unsigned num_threads)
+    : r_cutoff_(r_cutoff),
+      max_neighbors_(max_neighbors),
+      epsilon_(epsilon),
+      backend_(backend),
+      num_threads_(num_threads) {}
+
+NeighborView<double> NeighborList::neighbors(size_t atom_idx) const {
+    return table_.row(atom_idx);
 }
 
-void NeighborList::build_with_pbc(const crystal::Structure& structure) {
-    int num_images = compute_num_images(structure.lattice(), r_cutoff_);
-    PointCloud cloud = create_image_cloud(structure, num_images);
+// Rows that keep every neighbor within the cutoff only lose the vacancy. A row that was cut at
+// max_neighbors and contained the vacancy is searched again in the host with a slot for every
+// image of the removed atom, so the next-closest neighbors move up exactly as a rebuild on the
+// vacancy structure would find them.
+NeighborList NeighborList::with_vacancy(const crystal::Structure& host,
+                                        const crystal::VacancyMap& vacancy) const {
+    const size_t npos = std::numeric_limits<size_t>::max();
+    std::vector<size_t> new_index(num_atoms(), npos);
+    for (size_t i = 0; i < vacancy.host_index.size(); i++) {
+        new_index[vacancy.host_index[i]] = i;
+    }
+
+    // Small or periodic cells put several images of the removed atom in one row
+    auto vacancy_images = [&](NeighborView<double> row) {
+        return static_cast<size_t>(
+            std::count(row.indices.begin(), row.indices.end(), vacancy.removed));
+    };
+
+    std::vector<size_t> refill_atoms;
+    size_t extra_slots = 0;
+    for (size_t h : vacancy.host_index) {
+        NeighborView<double> row = neighbors(h);
+        size_t images = vacancy_images(row);
+        if (row.size() == max_neighbors_ && images > 0) {
+            refill_atoms.push_back(h);
+            extra_slots = std::max(extra_slots, images);
+        }
+    }
+
+    // The deeper search can reach further images, so widen it until no full row is left short
+    NeighborTable<double> refilled;
+    while (!refill_atoms.empty()) {
+        refilled = search(host, refill_atoms, max_neighbors_ + extra_slots);
+
+        size_t needed = extra_slots;
+        for (size_t r = 0; r < refill_atoms.size(); r++) {
+            NeighborView<double> row = refilled.row(r);
+            if (row.size() == max_neighbors_ + extra_slots) {
+                needed = std::max(needed, vacancy_images(row));
+            }
+        }
+        if (needed == extra_slots) {
+            break;
+        }
+        extra_slots = needed;
+    }
+
+    NeighborList result(r_cutoff_, max_neighbors_, epsilon_, backend_, num_threads_);
+    result.table_.offsets.reserve(vacancy.host_index.size() + 1);
+
+    std::vector<Neighbor> neighbor_list;
+    size_t next_refill = 0;
+
+    for (size_t h : vacancy.host_index) {
+        NeighborView<double> row = (next_refill < refill_atoms.size() &&
+                                    refill_atoms[next_refill] == h)
+                                       ? refilled.row(next_refill++)
+                                       : neighbors(h);
+
+        neighbor_list.clear();
+        for (size_t k = 0; k < row.size(); k++) {
+            if (row.indices[k] != vacancy.removed) {
+                neighbor_list.push_back(
+                    Neighbor(new_index[row.indices[k]], row.distances[k], row.displacement(k)));
+            }
+        }
+
+        // Renumbering can reorder equal distances, so restore the closer() order
+        std::sort(neighbor_list.begin(), neighbor_list.end(), closer);
+        neighbor_list.resize(std::min(neighbor_list.size(), max_neighbors_));
+
+        append_row(result.table_, neighbor_list);
+    }
+
+    return result;
+}
+
+NeighborList NeighborList::filtered(double r_cutoff, size_t max_neighbors) const {
+    if (!covers(r_cutoff, max_neighbors)) {
+        throw std::runtime_error("Filtered neighbor list exceeds the cutoff or neighbor count it "
+                                 "was built with");
+    }
+
+    NeighborList result(r_cutoff, max_neighbors, epsilon_, backend_, num_threads_);
+    NeighborTable<double>& table = result.table_;
+    table.offsets.reserve(table_.offsets.size());
+
+    for (size_t i = 0; i < num_atoms(); i++) {
+        NeighborView<double> row = neighbors(i);
+
+        // Rows are sorted by distance, so the neighbors within r_cutoff form a prefix
+        auto first = row.distances.begin();
+        auto last = first + static_cast<std::ptrdiff_t>(std::min(row.size(), max_neighbors));
+        auto count = std::lower_bound(first, last, r_cutoff) - first;
+
+        table.indices.insert(table.indices.end(), row.indices.begin(), row.indices.begin() + count);
+        table.distances.insert(
+            table.distances.end(), row.distances.begin(), row.distances.begin() + count);
+        table.dx.insert(table.dx.end(), row.dx.begin(), row.dx.begin() + count);
+        table.dy.insert(table.dy.end(), row.dy.begin(), row.dy.begin() + count);
+        table.dz.insert(table.dz.end(), row.dz.begin(), row.dz.begin() + count);
+        table.offsets.push_back(table.indices.size());
+    }
+
+    return result;
+}
+
+NeighborList NeighborList::with_vacancy(const crystal::Structure& host, size_t removed) const {
+    crystal::VacancyMap vacancy{removed, {}};
+    for (size_t h = 0; h < num_atoms(); h++) {
+        if (h != removed) {
+            vacancy.host_index.push_back(h);
+        }
+    }
+
+    return with_vacancy(host, vacancy);
+}
+
+NeighborTable<double> NeighborList::search(const crystal::Structure& structure,
+                                           std::span<const size_t> query_atoms,
+                                           size_t max_neighbors) const {
+    switch (backend_) {
+        case NeighborBackend::CellList:
+            return build_with_cell_list(structure, query_atoms, max_neighbors);
+        case NeighborBackend::KDTree:
+        default:
+            return build_with_pbc(structure, query_atoms, max_neighbors);
+    }
+}
+
+NeighborTable<double> NeighborList::build_with_pbc(const crystal::Structure& structure,
+                                                   std::span<const size_t> query_atoms,
+                                                   size_t max_neighbors) const {
+    Eigen::Vector3i num_images = compute_num_images(structure.lattice(), r_cutoff_);
+    PointCloud cloud = create_image_cloud(structure, num_images, r_cutoff_, num_threads_);
 
     NeighborList::KDTree tree =
         NeighborList::KDTree(3, cloud, nanoflann::KDTreeSingleIndexAdaptorParams(10));
     tree.buildIndex();
 
-    for (size_t i = 0; i < structure.num_atoms(); i++) {
-        Eigen::Vector3d query_pt = structure.atoms()[i].position;
+    // findNeighbors only reads the tree, so queries can share it across threads
+    auto query = [&](size_t i, BoundedNeighborHeap& heap) {
+        const Eigen::Vector3d query_pt = structure.position(i);
 
-        std::vector<nanoflann::ResultItem<unsigned int, double>> matches;
+        TopKResultSet<PointCloud> result(heap, cloud, query_pt, i, epsilon_, r_cutoff_ * r_cutoff_);
+        tree.findNeighbors(result, query_pt.data());
+    };
 
-        tree.radiusSearch(query_pt.data(), r_cutoff_ * r_cutoff_, matches);
+    return gather_rows(query_atoms, max_neighbors, num_threads_, query);
+}
 
-        std::vector<Neighbor> neighbor_list;
+NeighborTable<double> NeighborList::build_with_cell_list(const crystal::Structure& structure,
+                                                         std::span<const size_t> query_atoms,
+                                                         size_t max_neighbors) const {
+    const Eigen::Matrix3d& lattice = structure.lattice();
+    const size_t num_atoms = structure.num_atoms();
+    const std::array<std::span<const double>, 3> frac = {
+        structure.frac_x(), structure.frac_y(), structure.frac_z()};
 
-        for (const nanoflann::ResultItem<unsigned int, double>& match : matches) {
-            size_t orig_idx = cloud.original_index(match.first);
+    // Bins are at least r_cutoff wide, capped so the grid stays O(num_atoms) for tiny cutoffs.
+    // A query then reaches every bin whose fractional slab lies within r_cutoff / height.
+    Eigen::Vector3d heights = perpendicular_heights(lattice);
+    int max_bins_per_axis = 2 * static_cast<int>(std::ceil(std::cbrt(num_atoms))) + 1;
 
-            if (orig_idx == i && std::sqrt(match.second) < epsilon_) {
-                continue;
-            }
+    std::array<int, 3> num_bins{};
+    std::array<int, 3> reach{};
+    for (int k = 0; k < 3; k++) {
+        num_bins[k] = std::clamp(
+            static_cast<int>(std::floor(heights[k] / r_cutoff_)), 1, max_bins_per_axis);
+        reach[k] = static_cast<int>(std::ceil(r_cutoff_ * num_bins[k] / heights[k]));
+    }
 
-            auto delta_r = cloud.position(match.first) - query_pt;
+    auto flat_bin = [&](int a, int b, int c) {
+        return static_cast<size_t>((a * num_bins[1] + b) * num_bins[2] + c);
+    };
 
-            neighbor_list.push_back(Neighbor(orig_idx, std::sqrt(match.second), delta_r));
+    // Wrap every atom into the home cell; home_cell records the lattice shift that was removed
+    std::vector<std::array<int, 3>> home_cell(num_atoms);
+    std::vector<std::array<int, 3>> atom_bin(num_atoms);
+    std::vector<size_t> bin_start(static_cast<size_t>(num_bins[0] * num_bins[1] * num_bins[2]) + 1,
+                                  0);
+
+    for (size_t i = 0; i < num_atoms; i++) {
+        for (int k = 0; k < 3; k++) {
+            double floor_frac = std::floor(frac[k][i]);
+            double wrapped = frac[k][i] - floor_frac;
+
+            home_cell[i][k] = static_cast<int>(floor_frac);
+            atom_bin[i][k] = std::min(static_cast<int>(wrapped * num_bins[k]), num_bins[k] - 1);
         }
+        bin_start[flat_bin(atom_bin[i][0], atom_bin[i][1], atom_bin[i][2]) + 1]++;
+    }
+
+    for (size_t b = 1; b < bin_start.size(); b++) {
+        bin_start[b] += bin_start[b - 1];
+    }
+
+    std::vector<size_t> bin_atoms(num_atoms);
+    std::vector<size_t> fill(bin_start.begin(), bin_start.end() - 1);
+    for (size_t i = 0; i < num_atoms; i++) {
+        bin_atoms[fill[flat_bin(atom_bin[i][0], atom_bin[i][1], atom_bin[i][2])]++] = i;
+    }
+
+    auto query = [&](size_t i, BoundedNeighborHeap& heap) {
+        const Eigen::Vector3d query_pt = structure.position(i);
+
+        for (int o_a = -reach[0]; o_a <= reach[0]; o_a++) {
+            int raw_a = atom_bin[i][0] + o_a;
+            int shift_a = floor_div(raw_a, num_bins[0]);
+            int bin_a = raw_a - shift_a * num_bins[0];
+
+            for (int o_b = -reach[1]; o_b <= reach[1]; o_b++) {
+                int raw_b = atom_bin[i][1] + o_b;
+                int shift_b = floor_div(raw_b, num_bins[1]);
+                int bin_b = raw_b - shift_b * num_bins[1];
+
+                for (int o_c = -reach[2]; o_c <= reach[2]; o_c++) {
+                    int raw_c = atom_bin[i][2] + o_c;
+                    int shift_c = floor_div(raw_c, num_bins[2]);
+                    int bin_c = raw_c - shift_c * num_bins[2];
+
+                    size_t bin = flat_bin(bin_a, bin_b, bin_c);
 
-        std::sort(neighbor_list.begin(),
-                  neighbor_list.end(),
-                  [](const Neighbor& a, const Neighbor& b) { return a.distance < b.distance; });
+                    for (size_t slot = bin_start[bin]; slot < bin_start[bin + 1]; slot++) {
+                        size_t j = bin_atoms[slot];
 
-        if (neighbor_list.size() > max_neighbors_) {
-            neighbor_list.resize(max_neighbors_);
+                        // Same image position the KD-tree cloud would hold for atom j
+                        Eigen::Vector3d image =
+                            structure.position(j) +
+                            image_offset(lattice,
+                                         shift_a + home_cell[i][0] - home_cell[j][0],
+                                         shift_b + home_cell[i][1] - home_cell[j][1],
+                                         shift_c + home_cell[i][2] - home_cell[j][2]);
+                        Eigen::Vector3d delta_r = image - query_pt;
+
+                        double dist_sq = delta_r.x() * delta_r.x() + delta_r.y() * delta_r.y() +
+                                         delta_r.z() * delta_r.z();
+
+                        if (dist_sq >= heap.admission_dist_sq(r_cutoff_ * r_cutoff_)) {
+                            continue;
+                        }
+                        if (j == i && std::sqrt(dist_sq) < epsilon_) {
+                            continue;
+                        }
+
+                        heap.offer(Neighbor(j, std::sqrt(dist_sq), delta_r));
+                    }
+                }
+            }
         }
 
-        neighbor_lists_[i] = neighbor_list;
+    };
+
+    return gather_rows(query_atoms, max_neighbors, num_threads_, query);
+}
+
+// Image range per axis from the perpendicular height of the cell rather than the row norm, so long
+// axes get fewer images and skewed cells (height < row norm) still get enough.
+Eigen::Vector3i NeighborList::compute_num_images(const Eigen::Matrix3d& lattice, double r_cutoff) {
+    Eigen::Vector3d heights = perpendicular_heights(lattice);
+
+    Eigen::Vector3i num_images;
+    for (int k = 0; k < 3; k++) {
+        num_images[k] = static_cast<int>(std::ceil(r_cutoff / heights[k])) + 1;
     }
+
+    return num_images;
 }
 
-int NeighborList::compute_num_images(const Eigen::Matrix3d& lattice, double r_cutoff) {
-    double l_min = std::min({lattice.row(0).norm(), lattice.row(1).norm(), lattice.row(2).norm()});
+Eigen::Vector3d NeighborList::perpendicular_heights(const Eigen::Matrix3d& lattice) {
+    double volume = std::abs(lattice.determinant());
 
-    return static_cast<int>(std::ceil(r_cutoff / l_min)) + 1;
+    return {volume / lattice.row(1).cross(lattice.row(2)).norm(),
+            volume / lattice.row(2).cross(lattice.row(0)).norm(),
+            volume / lattice.row(0).cross(lattice.row(1)).norm()};
 }
 
 auto NeighborList::create_image_cloud(const crystal::Structure& structure,
-                                      int num_images) -> PointCloud {
+                                      const Eigen::Vector3i& num_images,
+                                      double r_cutoff,
+                                      unsigned num_threads) -> PointCloud {
     PointCloud cloud;
     Eigen::Matrix3d lattice = structure.lattice();
+    const size_t num_atoms = structure.num_atoms();
+
+    // Axis-aligned bounding box of the home-cell atoms. An image block whose shifted box is at
+    // least r_cutoff away from the home box cannot hold a neighbor of any home atom, so it is
+    // skipped.
+    Eigen::Vector3d box_min = Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+    Eigen::Vector3d box_max = -box_min;
+    for (size_t i = 0; i < num_atoms; i++) {
+        box_min = box_min.cwiseMin(structure.position(i));
+        box_max = box_max.cwiseMax(structure.position(i));
+    }
+    Eigen::Vector3d extent = box_max - box_min;
 
-    for (int n_a = -num_images; n_a <= num_images; n_a++) {
-        for (int n_b = -num_images; n_b <= num_images; n_b++) {
-            for (int n_c = -num_images; n_c <= num_images; n_c++) {
-                Eigen::Vector3d offset =
-                    (n_a * lattice.row(0) + n_b * lattice.row(1) + n_c * lattice.row(2))
-                        .transpose();
+    std::vector<Eigen::Vector3d> offsets;
+    for (int n_a = -num_images[0]; n_a <= num_images[0]; n_a++) {
+        for (int n_b = -num_images[1]; n_b <= num_images[1]; n_b++) {
+            for (int n_c = -num_images[2]; n_c <= num_images[2]; n_c++) {
+                Eigen::Vector3d offset = image_offset(lattice, n_a, n_b, n_c);
+                Eigen::Vector3d gap = (offset.cwiseAbs() - extent).cwiseMax(0.0);
 
-                for (int i = 0; i < static_cast<int>(structure.num_atoms()); i++) {
-                    cloud.add_point(structure.atoms()[i].position + offset, i);
+                if (gap.squaredNorm() < r_cutoff * r_cutoff) {
+                    offsets.push_back(offset);
                 }
             }
         }
     }
 
+    // Block o holds the images under offsets[o], so the fill order does not depend on threads
+    cloud.resize(offsets.size() * num_atoms);
+
+#pragma omp parallel for schedule(static) num_threads(team_size(num_threads))
+    for (size_t o = 0; o < offsets.size(); o++) {
+        for (size_t i = 0; i < num_atoms; i++) {
+            cloud.set_point(o * num_atoms + i, structure.position(i) + offsets[o], i);
+        }
+    }
+
     return cloud;
 }
 
-}  // namespace defect_gnn::graph
\ No newline at end of file
+}  // namespace defect_gnn::graph
@@ -0,0 +1,395 @@
+#include "io/binary_format.hpp"
+
+#include "utils/hash.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace defect_gnn::io {
+
+namespace {
+
+constexpr std::array<char, 8> MAGIC = {'D', 'G', 'N', 'N', 'A', 'R', 'R', '\0'};
+constexpr uint32_t BYTE_ORDER_TAG = 0x01020304;
+constexpr uint16_t VERSION = 1;
+constexpr size_t CHECKSUM_SIZE = sizeof(uint64_t);
+
+size_t element_width(Dtype dtype) {
+    switch (dtype) {
+    case Dtype::F64:
+        return sizeof(double);
+    case Dtype::F32:
+        return sizeof(float);
+    case Dtype::BF16:
+        return sizeof(uint16_t);
+    }
+    return 0;
+}
+
+template <typename T>
+void append(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Round to nearest even on the upper half of the float32 bits; NaN stays NaN
+uint16_t to_bfloat16(double value) {
+    auto f = static_cast<float>(value);
+    uint32_t bits = 0;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if (std::isnan(f)) {
+        return static_cast<uint16_t>((bits >> 16) | 0x0040);
+    }
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+double from_bfloat16(uint16_t half) {
+    uint32_t bits = static_cast<uint32_t>(half) << 16;
+    float f = 0.0F;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Elements in column-major order at the width of `dtype`
+std::string encode_elements(const Eigen::Ref<const Eigen::MatrixXd>& array, Dtype dtype) {
+    std::string bytes;
+    bytes.reserve(static_cast<size_t>(array.size()) * element_width(dtype));
+
+    for (Eigen::Index c = 0; c < array.cols(); c++) {
+        for (Eigen::Index r = 0; r < array.rows(); r++) {
+            double value = array(r, c);
+            switch (dtype) {
+            case Dtype::F64:
+                append(bytes, value);
+                break;
+            case Dtype::F32:
+                append(bytes, static_cast<float>(value));
+                break;
+            case Dtype::BF16:
+                append(bytes, to_bfloat16(value));
+                break;
+            }
+        }
+    }
+    return bytes;
+}
+
+Eigen::MatrixXd
+decode_elements(std::string_view bytes, Dtype dtype, Eigen::Index rows, Eigen::Index cols) {
+    Eigen::MatrixXd array(rows, cols);
+    const size_t width = element_width(dtype);
+
+    for (Eigen::Index i = 0; i < array.size(); i++) {
+        const char* element = bytes.data() + static_cast<size_t>(i) * width;
+        switch (dtype) {
+        case Dtype::F64:
+            std::memcpy(array.data() + i, element, sizeof(double));
+            break;
+        case Dtype::F32: {
+            float f = 0.0F;
+            std::memcpy(&f, element, sizeof(f));
+            array.data()[i] = f;
+            break;
+        }
+        case Dtype::BF16: {
+            uint16_t half = 0;
+            std::memcpy(&half, element, sizeof(half));
+            array.data()[i] = from_bfloat16(half);
+            break;
+        }
+        }
+    }
+    return array;
+}
+
+// Replaces every element's bits with their difference to the previous element's (mod 2^bits), or
+// undoes that
+template <typename Word>
+void delta_words(std::string& bytes, bool encode) {
+    Word previous = 0;
+    for (size_t offset = 0; offset + sizeof(Word) <= bytes.size(); offset += sizeof(Word)) {
+        Word word = 0;
+        std::memcpy(&word, bytes.data() + offset, sizeof(word));
+        Word out = encode ? static_cast<Word>(word - previous) : static_cast<Word>(word + previous);
+        previous = encode ? word : out;
+        std::memcpy(bytes.data() + offset, &out, sizeof(out));
+    }
+}
+
+void delta(std::string& bytes, size_t width, bool encode) {
+    switch (width) {
+    case sizeof(uint64_t):
+        delta_words<uint64_t>(bytes, encode);
+        break;
+    case sizeof(uint32_t):
+        delta_words<uint32_t>(bytes, encode);
+        break;
+    default:
+        delta_words<uint16_t>(bytes, encode);
+        break;
+    }
+}
+
+// Byte k of element i moves to k * n + i, so the similar high bytes of neighboring values line up
+std::string shuffle(const std::string& bytes, size_t width, bool forward) {
+    const size_t n = bytes.size() / width;
+    std::string out(bytes.size(), '\0');
+    for (size_t i = 0; i < n; i++) {
+        for (size_t k = 0; k < width; k++) {
+            if (forward) {
+                out[k * n + i] = bytes[i * width + k];
+            } else {
+                out[i * width + k] = bytes[k * n + i];
+            }
+        }
+    }
+    return out;
+}
+
+// Each run of zero bytes becomes a single zero followed by the run length as a LEB128 varint
+std::string encode_zero_runs(const std::string& bytes) {
+    std::string out;
+    for (size_t i = 0; i < bytes.size();) {
+        if (bytes[i] != '\0') {
+            out.push_back(bytes[i++]);
+            continue;
+        }
+
+        uint64_t run = 0;
+        while (i < bytes.size() && bytes[i] == '\0') {
+            run++;
+            i++;
+        }
+        out.push_back('\0');
+        do {
+            auto low = static_cast<uint8_t>(run & 0x7F);
+            run >>= 7;
+            out.push_back(static_cast<char>(run != 0 ? low | 0x80 : low));
+        } while (run != 0);
+    }
+    return out;
+}
+
+// Bounds-checked cursor over a file's bytes; every failure names the file
+class ByteReader {
+public:
+    ByteReader(std::string_view bytes, const std::string& filepath)
+        : bytes_(bytes), filepath_(filepath) {}
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Invalid array file " + filepath_ + ": " + what);
+    }
+
+    template <typename T>
+    T read() {
+        T value{};
+        std::memcpy(&value, take(sizeof(T)).data(), sizeof(T));
+        return value;
+    }
+
+    std::string_view take(size_t size) {
+        if (size > bytes_.size() - position_) {
+            fail("truncated");
+        }
+        std::string_view out = bytes_.substr(position_, size);
+        position_ += size;
+        return out;
+    }
+
+    [[nodiscard]] size_t remaining() const { return bytes_.size() - position_; }
+
+private:
+    std::string_view bytes_;
+    const std::string& filepath_;
+    size_t position_ = 0;
+};
+
+std::string decode_zero_runs(std::string_view payload, size_t expected, const ByteReader& file) {
+    std::string out;
+    out.reserve(std::min(expected, payload.size() * 16));
+
+    for (size_t i = 0; i < payload.size();) {
+        char byte = payload[i++];
+        if (byte != '\0') {
+            out.push_back(byte);
+        } else {
+            uint64_t run = 0;
+            for (int shift = 0;; shift += 7) {
+                if (i == payload.size() || shift > 63) {
+                    file.fail("bad run length");
+                }
+                auto part = static_cast<uint8_t>(payload[i++]);
+                run |= static_cast<uint64_t>(part & 0x7F) << shift;
+                if ((part & 0x80) == 0) {
+                    break;
+                }
+            }
+            if (run > expected - std::min(expected, out.size())) {
+                file.fail("payload longer than its shape");
+            }
+            out.append(run, '\0');
+        }
+
+        if (out.size() > expected) {
+            file.fail("payload longer than its shape");
+        }
+    }
+
+    if (out.size() != expected) {
+        file.fail("payload shorter than its shape");
+    }
+    return out;
+}
+
+}  // namespace
+
+Dtype parse_dtype(const std::string& name) {
+    if (name == "f64") {
+        return Dtype::F64;
+    }
+    if (name == "f32") {
+        return Dtype::F32;
+    }
+    if (name == "bf16") {
+        return Dtype::BF16;
+    }
+    throw std::runtime_error("Unknown dtype: " + name + " (expected f64, f32 or bf16)");
+}
+
+ArrayWriter::ArrayWriter(ArrayEncoding encoding) : encoding_(encoding) {}
+
+void ArrayWriter::add(const Eigen::Ref<const Eigen::MatrixXd>& array) {
+    if (num_arrays_ == std::numeric_limits<uint16_t>::max()) {
+        throw std::runtime_error("Too many arrays for one file");
+    }
+
+    const size_t width = element_width(encoding_.dtype);
+    std::string payload = encode_elements(array, encoding_.dtype);
+    if (encoding_.codec == Codec::SHUFFLE_DELTA) {
+        delta(payload, width, true);
+        payload = encode_zero_runs(shuffle(payload, width, true));
+    }
+
+    append(body_, static_cast<uint8_t>(encoding_.dtype));
+    append(body_, static_cast<uint8_t>(encoding_.codec));
+    body_.append(6, '\0');
+    append(body_, static_cast<uint64_t>(array.rows()));
+    append(body_, static_cast<uint64_t>(array.cols()));
+    append(body_, static_cast<uint64_t>(payload.size()));
+    body_ += payload;
+
+    num_arrays_++;
+}
+
+void ArrayWriter::save(const std::string& filepath) const {
+    std::string bytes(MAGIC.begin(), MAGIC.end());
+    append(bytes, BYTE_ORDER_TAG);
+    append(bytes, VERSION);
+    append(bytes, num_arrays_);
+    bytes += body_;
+    append(bytes, utils::fnv1a_64(bytes));
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for writing: " + filepath);
+    }
+    file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write: " + filepath);
+    }
+}
+
+std::vector<Eigen::MatrixXd> read_arrays(const std::string& filepath, size_t expected_arrays) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for reading: " + filepath);
+    }
+    const std::string bytes((std::istreambuf_iterator<char>(file)),
+                            std::istreambuf_iterator<char>());
+
+    ByteReader reader(bytes, filepath);
+    if (bytes.size() < MAGIC.size() || !std::equal(MAGIC.begin(), MAGIC.end(), bytes.begin())) {
+        reader.fail("not an array file (old raw format?)");
+    }
+    reader.take(MAGIC.size());
+    if (reader.read<uint32_t>() != BYTE_ORDER_TAG) {
+        reader.fail("written with a different byte order");
+    }
+    if (uint16_t version = reader.read<uint16_t>(); version != VERSION) {
+        reader.fail("unsupported version " + std::to_string(version));
+    }
+    const auto num_arrays = reader.read<uint16_t>();
+    if (num_arrays != expected_arrays) {
+        reader.fail(std::to_string(num_arrays) + " arrays, expected " +
+                    std::to_string(expected_arrays));
+    }
+
+    if (reader.remaining() < CHECKSUM_SIZE) {
+        reader.fail("truncated");
+    }
+    const std::string_view content(bytes.data(), bytes.size() - CHECKSUM_SIZE);
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, bytes.data() + content.size(), CHECKSUM_SIZE);
+    if (utils::fnv1a_64(content) != checksum) {
+        reader.fail("checksum mismatch");
+    }
+
+    std::vector<Eigen::MatrixXd> arrays;
+    for (uint16_t a = 0; a < num_arrays; a++) {
+        const auto dtype = reader.read<uint8_t>();
+        const auto codec = reader.read<uint8_t>();
+        reader.take(6);
+        const auto rows = reader.read<uint64_t>();
+        const auto cols = reader.read<uint64_t>();
+        const auto payload_size = reader.read<uint64_t>();
+
+        if (dtype > static_cast<uint8_t>(Dtype::BF16) ||
+            codec > static_cast<uint8_t>(Codec::SHUFFLE_DELTA)) {
+            reader.fail("unknown dtype or codec");
+        }
+        const size_t width = element_width(static_cast<Dtype>(dtype));
+        const auto max_elements =
+            static_cast<uint64_t>(std::numeric_limits<Eigen::Index>::max()) / width;
+        if (cols != 0 && rows > max_elements / cols) {
+            reader.fail("shape too large");
+        }
+        const size_t raw_size = rows * cols * width;
+
+        std::string_view payload = reader.take(payload_size);
+        std::string raw;
+        if (static_cast<Codec>(codec) == Codec::RAW) {
+            if (payload.size() != raw_size) {
+                reader.fail("payload size does not match its shape");
+            }
+            raw = payload;
+        } else {
+            raw = shuffle(decode_zero_runs(payload, raw_size, reader), width, false);
+            delta(raw, width, false);
+        }
+
+        arrays.push_back(decode_elements(raw,
+                                         static_cast<Dtype>(dtype),
+                                         static_cast<Eigen::Index>(rows),
+                                         static_cast<Eigen::Index>(cols)));
+    }
+
+    if (reader.remaining() != CHECKSUM_SIZE) {
+        reader.fail("trailing bytes");
+    }
+    return arrays;
+}
+
+}  // namespace defect_gnn::io
@@ -0,0 +1,92 @@
+#include "io/manifest.hpp"
+
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <ios>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace defect_gnn::io {
+
+// Line layout: id, input hash, params hash, then comma-separated output checksums, the hashes in
+// hex and the fields separated by tabs. Lines starting with '#' are comments.
+Manifest::Manifest(std::string filepath) : filepath_(std::move(filepath)) {
+    std::ifstream file(filepath_);
+    std::string line;
+    while (std::getline(file, line)) {
+        // A line without its newline was cut short by a crash. Whatever it parses to is dropped,
+        // and the next append starts on a fresh line instead of extending it.
+        if (file.eof()) {
+            torn_tail_ = true;
+            break;
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        ManifestEntry entry;
+        std::string checksums;
+        if (!(fields >> entry.id >> std::hex >> entry.input_hash >> entry.params_hash >>
+              checksums)) {
+            continue;
+        }
+
+        std::istringstream list(checksums);
+        std::string checksum;
+        while (std::getline(list, checksum, ',')) {
+            entry.output_checksums.push_back(std::stoull(checksum, nullptr, 16));
+        }
+
+        entries_.insert_or_assign(entry.id, std::move(entry));
+    }
+}
+
+std::optional<ManifestEntry> Manifest::find(const std::string& id) const {
+    std::lock_guard lock(mutex_);
+
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void Manifest::append(const ManifestEntry& entry) {
+    std::string checksums;
+    for (uint64_t checksum : entry.output_checksums) {
+        checksums += std::format("{}{:016x}", checksums.empty() ? "" : ",", checksum);
+    }
+
+    std::lock_guard lock(mutex_);
+
+    std::ofstream file(filepath_, std::ios::app);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for writing: " + filepath_);
+    }
+
+    file << std::format("{}{}\t{:016x}\t{:016x}\t{}\n",
+                        torn_tail_ ? "\n" : "",
+                        entry.id,
+                        entry.input_hash,
+                        entry.params_hash,
+                        checksums);
+    file.flush();
+    if (!file) {
+        throw std::runtime_error("Failed to write manifest: " + filepath_);
+    }
+    torn_tail_ = false;
+
+    entries_.insert_or_assign(entry.id, entry);
+}
+
+size_t Manifest::size() const {
+    std::lock_guard lock(mutex_);
+    return entries_.size();
+}
+
+}  // namespace defect_gnn::io
@@ -2,56 +2,205 @@
 
 #include <Eigen/Dense>
 
-#include <fstream>
-#include <numeric>
-#include <sstream>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
 #include <vector>
 
 namespace defect_gnn::io {
 
-VASPStructure parse_vasp(const std::string& filepath) {  // NOLINT(readability-function-size)
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        throw std::runtime_error("Could not open file: " + filepath);
+namespace {
+
+// Read-only mapping of a whole file, unmapped on destruction
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filepath) {
+        int fd = ::open(filepath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file: " + filepath);
+        }
+
+        struct stat info {};
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not open file: " + filepath);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+
+        // mmap rejects empty lengths; an empty file is left to the parser to report
+        if (size_ > 0) {
+            void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map file: " + filepath);
+            }
+            data_ = static_cast<const char*>(mapping);
+        }
+        ::close(fd);
     }
 
-    std::vector<std::string> lines;
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    [[nodiscard]] std::string_view content() const { return {data_, size_}; }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        lines.push_back(line);
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// The characters istream treats as separators
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Splits the next whitespace-delimited token off the front of `line`; empty once it runs out
+std::string_view next_token(std::string_view& line) {
+    size_t begin = 0;
+    while (begin < line.size() && is_space(line[begin])) {
+        begin++;
+    }
+    size_t end = begin;
+    while (end < line.size() && !is_space(line[end])) {
+        end++;
+    }
+
+    std::string_view token = line.substr(begin, end - begin);
+    line.remove_prefix(end);
+    return token;
+}
+
+// The whole token must be the number. A leading '+' is accepted as istream does.
+bool parse_number(std::string_view token, int& value) {
+    if (token.size() > 1 && token[0] == '+' && token[1] != '-') {
+        token.remove_prefix(1);
     }
+    auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    return error == std::errc() && end == token.data() + token.size();
+}
 
+bool parse_number(std::string_view token, double& value) {
+    if (token.size() > 1 && token[0] == '+' && token[1] != '-') {
+        token.remove_prefix(1);
+    }
+#if defined(__cpp_lib_to_chars)
+    auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+    return error == std::errc() && end == token.data() + token.size();
+#else
+    // Standard libraries without floating-point from_chars (older libc++, as in some Emscripten
+    // releases): strtod needs a terminated copy, which fits on the stack for any sane number
+    std::array<char, 64> buffer{};
+    if (token.empty() || token.size() >= buffer.size()) {
+        return false;
+    }
+    std::memcpy(buffer.data(), token.data(), token.size());
+    char* end = nullptr;
+    value = std::strtod(buffer.data(), &end);
+    return end == buffer.data() + token.size();
+#endif
+}
+
+// Walks the buffer line by line, tracking the line number for error messages
+class LineReader {
+public:
+    LineReader(std::string_view content, std::string_view source)
+        : rest_(content), source_(source) {}
+
+    std::string_view next_line() {
+        line_number_++;
+        if (rest_.empty()) {
+            fail("unexpected end of file");
+        }
+
+        size_t newline = rest_.find('\n');
+        std::string_view line = rest_.substr(0, newline);
+        rest_.remove_prefix(newline == std::string_view::npos ? rest_.size() : newline + 1);
+        return line;
+    }
+
+    // Reads `values.size()` numbers from the front of the next line; anything after them is
+    // ignored, like the selective dynamics flags on a position line
+    void read_numbers(std::span<double> values, const char* what) {
+        std::string_view line = next_line();
+        for (double& value : values) {
+            if (!parse_number(next_token(line), value)) {
+                fail(std::string("expected ") + what);
+            }
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("Invalid POSCAR " + std::string(source_) + " line " +
+                                 std::to_string(line_number_) + ": " + message);
+    }
+
+private:
+    std::string_view rest_;
+    std::string_view source_;
+    int line_number_ = 0;
+};
+
+}  // namespace
+
+VASPStructure parse_vasp(const std::string& filepath) {
+    MappedFile file(filepath);
+    return parse_vasp_string(file.content(), filepath);
+}
+
+VASPStructure parse_vasp_string(std::string_view content, std::string_view source) {
+    LineReader reader(content, source);
     VASPStructure vasp;
 
-    std::stringstream scale_ss(lines[1]);
+    // Line 1: comment
+    reader.next_line();
+
     double scale_factor = 1.0;
-    scale_ss >> scale_factor;
+    reader.read_numbers({&scale_factor, 1}, "a scale factor");
 
     for (int i = 0; i < 3; i++) {
-        std::stringstream iss(lines[i + 2]);
-
-        iss >> vasp.lattice(i, 0) >> vasp.lattice(i, 1) >> vasp.lattice(i, 2);
+        std::array<double, 3> row{};
+        reader.read_numbers(row, "three lattice vector components");
+        vasp.lattice.row(i) << row[0], row[1], row[2];
     }
 
     vasp.lattice *= scale_factor;
 
-    std::stringstream elem_ss(lines[5]);
-    std::string elem;
-    while (elem_ss >> elem) {
-        vasp.elements.push_back(elem);
+    std::string_view elements = reader.next_line();
+    for (std::string_view elem = next_token(elements); !elem.empty();
+         elem = next_token(elements)) {
+        vasp.elements.emplace_back(elem);
     }
 
-    std::stringstream count_ss(lines[6]);
+    // Counts run up to the first token that is not an integer
+    std::string_view counts = reader.next_line();
+    int total_atoms = 0;
     int count = -1;
-    while (count_ss >> count) {
+    while (parse_number(next_token(counts), count)) {
+        if (count < 0) {
+            reader.fail("negative element count");
+        }
         vasp.counts.push_back(count);
+        total_atoms += count;
     }
 
-    bool is_direct = lines[7][0] == 'd' || lines[7][0] == 'D';
-
-    int total_atoms = std::reduce(vasp.counts.begin(), vasp.counts.end());
+    std::string_view mode = reader.next_line();
+    bool is_direct = !mode.empty() && (mode[0] == 'd' || mode[0] == 'D');
 
     vasp.frac_coords.resize(total_atoms, 3);
     vasp.atom_types.resize(total_atoms);
@@ -59,10 +208,9 @@ VASPStructure parse_vasp(const std::string& filepath) {  // NOLINT(readability-f
     int atom_idx = 0;
     for (int elem_idx = 0; elem_idx < static_cast<int>(vasp.counts.size()); ++elem_idx) {
         for (int j = 0; j < vasp.counts[elem_idx]; ++j) {
-            std::stringstream atom_ss(lines[atom_idx + 8]);
-
-            atom_ss >> vasp.frac_coords(atom_idx, 0) >> vasp.frac_coords(atom_idx, 1) >>
-                vasp.frac_coords(atom_idx, 2);
+            std::array<double, 3> position{};
+            reader.read_numbers(position, "three atom coordinates");
+            vasp.frac_coords.row(atom_idx) << position[0], position[1], position[2];
             vasp.atom_types[atom_idx] = elem_idx;
 
             ++atom_idx;
@@ -77,4 +225,4 @@ VASPStructure parse_vasp(const std::string& filepath) {  // NOLINT(readability-f
     return vasp;
 }
 
-}  // namespace defect_gnn::io
\ No newline at end of file
+}  // namespace defect_gnn::io
@@ -1,16 +1,33 @@
 
 #include "crystal/structure.hpp"
+#include "graph/neighbor_list.hpp"
+#include "io/binary_format.hpp"
+#include "io/manifest.hpp"
 #include "io/vasp_parser.hpp"
 #include "topology/betti_features.hpp"
+#include "topology/feature_cache.hpp"
+#include "topology/feature_dataset.hpp"
 #include "topology/pca.hpp"
+#include "utils/bounded_queue.hpp"
+#include "utils/hash.hpp"
 #include "utils/logging.hpp"
+#include "utils/task_scheduler.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
 #include <format>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <spdlog/spdlog.h>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,16 +44,248 @@ std::pair<int, int> parse_structure_id(const std::string& id) {
     return {std::stoi(id.substr(0, underscore)), std::stoi(id.substr(underscore + 1))};
 }
 
+// Parse a comma-separated cutoff list such as "5,7.5,10"
+std::vector<double> parse_cutoffs(const std::string& list) {
+    std::vector<double> cutoffs;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = std::min(list.find(',', start), list.size());
+        cutoffs.push_back(std::stod(list.substr(start, comma - start)));
+        start = comma + 1;
+    }
+    return cutoffs;
+}
+
+// Which slice of the host structures this process handles: the hosts whose structure number is
+// `index` mod `count`, each with all its variants
+struct Shard {
+    unsigned index = 0;
+    unsigned count = 1;
+
+    [[nodiscard]] bool sharded() const { return count > 1; }
+
+    // Distinguishes the per-process files (manifest, feature cache, PCA moments) of a shard
+    [[nodiscard]] std::string suffix() const {
+        return sharded() ? std::format(".shard{}of{}", index, count) : "";
+    }
+
+    [[nodiscard]] bool contains(int struct_num) const {
+        return static_cast<unsigned>(struct_num) % count == index;
+    }
+};
+
+// Parse "i/N" with 0 <= i < N
+Shard parse_shard(const std::string& spec) {
+    size_t slash = spec.find('/');
+    if (slash == std::string::npos) {
+        throw std::runtime_error("Shard must be given as i/N: " + spec);
+    }
+
+    Shard shard{static_cast<unsigned>(std::stoul(spec.substr(0, slash))),
+                static_cast<unsigned>(std::stoul(spec.substr(slash + 1)))};
+    if (shard.count == 0 || shard.index >= shard.count) {
+        throw std::runtime_error("Shard index out of range: " + spec);
+    }
+    return shard;
+}
+
+// Output directory per cutoff: processed_path itself, or processed_path/r<cutoff> for several
+std::vector<std::string> cutoff_output_paths(const std::string& processed_path,
+                                             const std::vector<double>& r_cutoffs) {
+    std::vector<std::string> output_paths;
+    for (double r_cutoff : r_cutoffs) {
+        output_paths.push_back(r_cutoffs.size() == 1
+                                   ? processed_path
+                                   : std::format("{}/r{}", processed_path, r_cutoff));
+    }
+    return output_paths;
+}
+
+// Solve and save a PCA model accumulated over the rows of every structure
+void fit_pca(topology::PCA& pca, int n_pca_components, const std::string& model_path) {
+    spdlog::info("Fitting PCA on {} atoms...", pca.num_samples());
+    pca.finalize(n_pca_components);
+    pca.save(model_path);
+
+    spdlog::info("Total atoms: {}", pca.num_samples());
+    spdlog::info("PCA explained variance ratio: {}", pca.explained_variance_ratio().sum());
+}
+
+namespace {
+
+// A pristine structure and its vacancy variants, parsed by the reader stage. The group is the unit
+// of work of the compute stage because variants derive their neighbor lists from the host's.
+struct StructureGroup {
+    int struct_num = 0;
+    size_t first_index = 0;  // position of ids[0] in the sorted structure list
+    size_t start_after = 0;  // how far the writer must have got before the group may start
+    std::vector<std::string> ids;
+    std::vector<crystal::Structure> structures;
+    std::vector<uint64_t> input_hashes;
+
+    // Per-cutoff features of the structures the manifest lists as up to date
+    std::vector<std::optional<std::vector<Eigen::MatrixXd>>> stored;
+};
+
+// How far the writer has got through the sorted structures. Compute workers wait on it before
+// starting a group, which bounds how far ahead of the writer they can run.
+class WriteProgress {
+public:
+    // False if closed first
+    bool wait_until(size_t index) {
+        std::unique_lock lock(mutex_);
+        advanced_.wait(lock, [&] { return closed_ || next_index_ >= index; });
+        return !closed_;
+    }
+
+    void advance(size_t next_index) {
+        {
+            std::lock_guard lock(mutex_);
+            next_index_ = next_index;
+        }
+        advanced_.notify_all();
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mutex_);
+            closed_ = true;
+        }
+        advanced_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable advanced_;
+    size_t next_index_ = 0;
+    bool closed_ = false;
+};
+
+// The features of one structure on their way to disk, the manifest and the PCA input
+struct StructureWrite {
+    size_t index = 0;
+    std::string id;
+    uint64_t input_hash = 0;
+    bool stored = false;  // already on disk and in the manifest
+    std::vector<Eigen::MatrixXd> features;
+};
+
+std::string betti_path(const std::string& output_path, const std::string& id) {
+    return std::format("{}/betti/{}.bin", output_path, id);
+}
+
+// Everything besides the input file that determines the output bytes
+uint64_t hash_parameters(const std::vector<double>& r_cutoffs,
+                         const topology::PersistenceOptions& options,
+                         io::ArrayEncoding storage) {
+    std::string params =
+        std::format("betti dim={} collapse={} landmark={} format=1 dtype={} codec={}",
+                    topology::BETTI_FEATURE_DIM,
+                    options.collapse_edges,
+                    options.landmark_radius,
+                    static_cast<int>(storage.dtype),
+                    static_cast<int>(storage.codec));
+    for (double r_cutoff : r_cutoffs) {
+        params += std::format(" r={}", r_cutoff);
+    }
+    return utils::fnv1a_64(params);
+}
+
+// The stored features of `id` when its manifest entry matches the input and parameters and every
+// output file still has the recorded checksum
+std::optional<std::vector<Eigen::MatrixXd>>
+load_up_to_date(const io::Manifest& manifest,
+                const std::string& id,
+                uint64_t input_hash,
+                uint64_t params_hash,
+                const std::vector<std::string>& outputs) {
+    std::optional<io::ManifestEntry> entry = manifest.find(id);
+    if (!entry || entry->input_hash != input_hash || entry->params_hash != params_hash ||
+        entry->output_checksums.size() != outputs.size()) {
+        return std::nullopt;
+    }
+
+    std::vector<Eigen::MatrixXd> features;
+    for (size_t c = 0; c < outputs.size(); c++) {
+        std::string path = betti_path(outputs[c], id);
+        if (!fs::exists(path) || utils::hash_file(path) != entry->output_checksums[c]) {
+            return std::nullopt;
+        }
+        features.push_back(topology::load_betti_features(path));
+    }
+    return features;
+}
+
+}  // namespace
+
+// Packs betti/<id>.bin of the given structures, in this order, into betti.pack
+void pack_features(const std::string& output_path, const std::vector<std::string>& ids) {
+    topology::FeatureDatasetWriter pack(output_path + "/betti.pack");
+    for (const std::string& id : ids) {
+        pack.add(id, topology::load_betti_features(betti_path(output_path, id)));
+    }
+    pack.finish();
+    spdlog::info("Packed {} structures into {}/betti.pack", ids.size(), output_path);
+}
+
+// Ids of every betti/*.bin under output_path, in structure order
+std::vector<std::string> stored_structure_ids(const std::string& output_path) {
+    std::vector<std::string> ids;
+    for (const auto& entry : fs::directory_iterator(output_path + "/betti")) {
+        if (entry.path().extension() == ".bin") {
+            ids.push_back(entry.path().stem().string());
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [](const std::string& a, const std::string& b) {
+        return parse_structure_id(a) < parse_structure_id(b);
+    });
+    return ids;
+}
+
+// Converts an existing per-file output to the packed layout: every betti/*.bin of each cutoff, in
+// structure order
+void pack_directory(const std::string& processed_path, const std::vector<double>& r_cutoffs) {
+    for (const std::string& output_path : cutoff_output_paths(processed_path, r_cutoffs)) {
+        pack_features(output_path, stored_structure_ids(output_path));
+    }
+}
+
+// With several cutoffs, one neighbor search at the largest serves all of them and each cutoff
+// writes its own betti/ and pca_model.bin under processed_path/r<cutoff>.
+// Structures flow through three stages joined by bounded queues: a reader parsing host groups in
+// order, compute workers taking whole groups and a writer saving the .bin files. A worker starts a
+// group only when fewer than 2 * workers groups before it are still unwritten, so parsed, computed
+// and pending structures stay within a few groups per worker. The workers hand their atoms to
+// one shared scheduler, which runs the most expensive pending ones first and at most
+// max_heavy_tasks heavy neighborhoods at once (0: half the threads).
+// processed_path/manifest.tsv records every finished structure as soon as its files are written.
+// A rerun reloads the structures whose input, parameters and outputs are unchanged instead of
+// recomputing them, so an interrupted run resumes and new inputs cost only their own time.
+// A shard processes only its hosts and saves the merged PCA moments of its structures instead of
+// the model; merge_shards then combines the shards' moments into the model. A complete run also
+// packs the features of each cutoff into betti.pack.
 void preprocess_all_structure(const std::string& raw_path,  // NOLINT(readability-function-size)
                               const std::string& processed_path,
-                              double r_cutoff = 10,  // NOLINT(bugprone-easily-swappable-parameters)
+                              const std::vector<double>& r_cutoffs,
                               int n_pca_components = 6,
-                              unsigned num_threads = 8) {
+                              unsigned num_threads = 8,
+                              topology::PersistenceOptions persistence_options = {},
+                              unsigned max_heavy_tasks = 0,
+                              Shard shard = {},
+                              io::ArrayEncoding storage = {}) {
+    const double max_cutoff = *std::max_element(r_cutoffs.begin(), r_cutoffs.end());
+
+    const std::vector<std::string> output_paths = cutoff_output_paths(processed_path, r_cutoffs);
+    for (const std::string& output_path : output_paths) {
+        fs::create_directories(output_path + "/betti");
+    }
+
     std::vector<std::string> structure_ids;
 
     for (const auto& entry : fs::directory_iterator(raw_path)) {
-        if (entry.path().extension() == ".vasp") {
-            structure_ids.push_back(entry.path().stem().string());
+        std::string id = entry.path().stem().string();
+        if (entry.path().extension() == ".vasp" && shard.contains(parse_structure_id(id).first)) {
+            structure_ids.push_back(id);
         }
     }
 
@@ -45,65 +294,337 @@ void preprocess_all_structure(const std::string& raw_path,  // NOLINT(readabilit
             return parse_structure_id(a) < parse_structure_id(b);
         });
 
-    std::map<int, int> defects_per_structure;
-    for (const auto& id : structure_ids) {
-        auto [struct_num, defect_num] = parse_structure_id(id);
-        defects_per_structure[struct_num]++;
+    // Consecutive ids with the same structure number form a group
+    std::vector<StructureGroup> groups;
+    for (size_t i = 0; i < structure_ids.size(); ++i) {
+        int struct_num = parse_structure_id(structure_ids[i]).first;
+        if (groups.empty() || groups.back().struct_num != struct_num) {
+            groups.push_back({struct_num, i, 0, {}, {}, {}, {}});
+        }
+        groups.back().ids.push_back(structure_ids[i]);
     }
 
-    spdlog::info("Found {} defective structures from {} base structures",
+    spdlog::info("Found {} defective structures from {} base structures{}",
                  structure_ids.size(),
-                 defects_per_structure.size());
+                 groups.size(),
+                 shard.sharded() ? std::format(" in shard {}/{}", shard.index, shard.count) : "");
 
-    std::vector<Eigen::MatrixXd> all_structure_features;
-    int current_structure_num = -1;
+    // Compute workers mostly wait on the scheduler, which owns the thread budget; several of them
+    // keep atoms of several structures in its queues at once
+    num_threads = std::max(1U, num_threads);
+    const auto num_workers =
+        static_cast<unsigned>(std::clamp<size_t>(groups.size(), 1, num_threads));
+    if (max_heavy_tasks == 0) {
+        max_heavy_tasks = std::max(1U, num_threads / 2);
+    }
+    utils::TaskScheduler scheduler(num_threads, max_heavy_tasks);
+    spdlog::info("{} compute workers, {} scheduler threads, at most {} heavy atoms at once",
+                 num_workers,
+                 num_threads,
+                 max_heavy_tasks);
 
-    for (size_t i = 0; i < structure_ids.size(); ++i) {
-        const std::string& structure_id = structure_ids[i];
-        auto [struct_num, defect_num] = parse_structure_id(structure_id);
+    // A group starts only once the writer has finished every group at least `window` places
+    // before it. A worker stuck on one heavy group then holds the others back instead of letting
+    // their output pile up in the writer.
+    const size_t window = 2 * static_cast<size_t>(num_workers);
+    for (size_t g = window; g < groups.size(); g++) {
+        groups[g].start_after = groups[g - window + 1].first_index;
+    }
+    WriteProgress write_progress;
 
-        if (struct_num != current_structure_num) {
-            current_structure_num = struct_num;
-            spdlog::info("[{}/{}] Processing structure {} ({} defects)",
-                         i + 1,
-                         structure_ids.size(),
-                         struct_num,
-                         defects_per_structure[struct_num]);
+    // One streaming PCA per cutoff; only its mean and scatter matrix stay in memory
+    std::vector<topology::PCA> pcas(r_cutoffs.size());
+
+    std::vector<topology::FeatureDatasetWriter> packs;
+    if (!shard.sharded()) {
+        for (const std::string& output_path : output_paths) {
+            packs.emplace_back(output_path + "/betti.pack");
+        }
+    }
+
+    topology::CollapseCounters collapse_counters;
+    persistence_options.counters = &collapse_counters;
+    std::atomic<size_t> derived_count{0};
+
+    // Per-atom rows keyed by local environment, reused across variants, hosts and runs
+    const std::string cache_path =
+        std::format("{}/feature_cache{}.bin", processed_path, shard.suffix());
+    topology::FeatureCache cache;
+    if (fs::exists(cache_path)) {
+        cache.load(cache_path);
+        spdlog::info("Loaded {} cached environments from {}", cache.size(), cache_path);
+    }
+
+    io::Manifest manifest(std::format("{}/manifest{}.tsv", processed_path, shard.suffix()));
+    const uint64_t params_hash = hash_parameters(r_cutoffs, persistence_options, storage);
+    std::atomic<size_t> reused_count{0};
+
+    utils::BoundedQueue<StructureGroup> group_queue(num_workers);
+    utils::BoundedQueue<StructureWrite> write_queue(2 * num_workers);
+
+    // The first failure in any stage closes both queues so every other stage winds down
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto fail = [&] {
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        group_queue.close();
+        write_queue.close();
+        write_progress.close();
+    };
+
+    std::thread reader([&] {
+        try {
+            for (StructureGroup& group : groups) {
+                StructureGroup parsed{
+                    group.struct_num, group.first_index, group.start_after, group.ids, {}, {}, {}};
+                for (const std::string& id : parsed.ids) {
+                    std::string input_path = std::format("{}/{}.vasp", raw_path, id);
+                    uint64_t input_hash = utils::hash_file(input_path);
+
+                    parsed.structures.emplace_back(io::parse_vasp(input_path));
+                    parsed.input_hashes.push_back(input_hash);
+                    parsed.stored.push_back(
+                        load_up_to_date(manifest, id, input_hash, params_hash, output_paths));
+                }
+                if (!group_queue.push(std::move(parsed))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail();
         }
+        group_queue.close();
+    });
+
+    auto compute = [&] {
+        try {
+            while (std::optional<StructureGroup> group = group_queue.pop()) {
+                if (!write_progress.wait_until(group->start_after)) {
+                    return;  // another stage failed
+                }
+
+                spdlog::info("[{}/{}] Processing structure {} ({} defects)",
+                             group->first_index + 1,
+                             structure_ids.size(),
+                             group->struct_num,
+                             group->ids.size());
 
-        io::VASPStructure vasp = io::parse_vasp(std::format("{}/{}.vasp", raw_path, structure_id));
+                // Pristine structure of the group; its vacancy variants derive their neighbor
+                // lists from this instead of searching again
+                const crystal::Structure* host = nullptr;
+                std::optional<graph::NeighborList> host_neighbors;
 
-        crystal::Structure structure(vasp);
+                // A stored host still needs its neighbor list when some variant is recomputed
+                const bool all_stored =
+                    std::all_of(group->stored.begin(), group->stored.end(), [](const auto& f) {
+                        return f.has_value();
+                    });
 
-        Eigen::MatrixXd features =
-            topology::compute_structure_betti_features(structure, r_cutoff, num_threads);
+                for (size_t k = 0; k < group->ids.size(); k++) {
+                    const crystal::Structure& structure = group->structures[k];
+                    const int defect_num = parse_structure_id(group->ids[k]).second;
+                    const bool stored = group->stored[k].has_value();
 
-        topology::save_betti_features(std::format("{}/betti/{}.bin", processed_path, structure_id),
-                                      features);
+                    StructureWrite write{
+                        group->first_index + k, group->ids[k], group->input_hashes[k], stored, {}};
+                    if (stored) {
+                        write.features = std::move(*group->stored[k]);
+                        reused_count++;
+                    }
+
+                    if (stored && (defect_num != 0 || all_stored)) {
+                        if (!write_queue.push(std::move(write))) {
+                            return;  // another stage failed
+                        }
+                        continue;
+                    }
+
+                    std::optional<crystal::VacancyMap> vacancy;
+                    if (defect_num != 0 && host_neighbors) {
+                        vacancy = crystal::match_vacancy(*host, structure);
+                    }
+
+                    // The search runs single-threaded as a scheduler task, so it counts against
+                    // the thread budget; its cost puts it ahead of every queued atom, which keeps
+                    // this structure's atoms from waiting behind other structures
+                    std::optional<graph::NeighborList> neighbors;
+                    auto build_neighbors = [&] {
+                        if (vacancy) {
+                            neighbors.emplace(host_neighbors->with_vacancy(*host, *vacancy));
+                            derived_count++;
+                        } else {
+                            neighbors.emplace(structure,
+                                              max_cutoff,
+                                              std::numeric_limits<size_t>::max(),
+                                              1e-10,
+                                              graph::NeighborBackend::KDTree,
+                                              1);
+                        }
+                    };
+                    std::vector<utils::TaskScheduler::Task> search;
+                    search.push_back(
+                        {std::numeric_limits<double>::infinity(), false, build_neighbors});
+                    scheduler.run_batch(std::move(search));
+
+                    if (!stored) {
+                        write.features =
+                            topology::compute_structure_betti_features(structure,
+                                                                       *neighbors,
+                                                                       r_cutoffs,
+                                                                       1,
+                                                                       &cache,
+                                                                       persistence_options,
+                                                                       &scheduler);
+                    }
+
+                    if (defect_num == 0) {
+                        host = &structure;
+                        host_neighbors = std::move(neighbors);
+                    }
+
+                    if (!write_queue.push(std::move(write))) {
+                        return;  // another stage failed
+                    }
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+    };
+
+    // Saves and records new features, then feeds every structure to PCA and the pack in sorted
+    // order, so neither depends on which worker finished first. Structures that arrive early wait
+    // in `pending`; the write window caps it at the structures of 2 * workers groups.
+    std::thread writer([&] {
+        try {
+            std::map<size_t, StructureWrite> pending;
+            size_t next_index = 0;
+
+            while (std::optional<StructureWrite> write = write_queue.pop()) {
+                if (!write->stored) {
+                    io::ManifestEntry entry{write->id, write->input_hash, params_hash, {}};
+                    for (size_t c = 0; c < r_cutoffs.size(); c++) {
+                        std::string path = betti_path(output_paths[c], write->id);
+                        topology::save_betti_features(path, write->features[c], storage);
+                        entry.output_checksums.push_back(utils::hash_file(path));
+
+                        // Fit and pack what a rerun would read back, not the unrounded values
+                        if (storage.dtype != io::Dtype::F64) {
+                            write->features[c] = topology::load_betti_features(path);
+                        }
+                    }
+                    manifest.append(entry);
+                }
+
+                const size_t index = write->index;
+                pending.emplace(index, std::move(*write));
+                while (!pending.empty() && pending.begin()->first == next_index) {
+                    const StructureWrite& next = pending.begin()->second;
+                    for (size_t c = 0; c < r_cutoffs.size(); c++) {
+                        pcas[c].partial_fit(next.features[c]);
+                        if (!shard.sharded()) {
+                            packs[c].add(next.id, next.features[c]);
+                        }
+                    }
+                    pending.erase(pending.begin());
+                    next_index++;
+                }
+                write_progress.advance(next_index);
+            }
+        } catch (...) {
+            fail();
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < num_workers; w++) {
+        workers.emplace_back(compute);
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    reader.join();
+    write_queue.close();
+    writer.join();
 
-        all_structure_features.push_back(features);
+    if (error) {
+        std::rethrow_exception(error);
     }
 
-    size_t total_atoms = 0;
-    for (const Eigen::MatrixXd& f : all_structure_features) {
-        total_atoms += f.rows();
+    cache.save(cache_path);
+    spdlog::info("Feature cache: {} hits, {} misses, {} environments saved",
+                 cache.hits(),
+                 cache.misses(),
+                 cache.size());
+
+    if (persistence_options.collapse_edges) {
+        size_t edges = collapse_counters.edges;
+        size_t collapsed = collapse_counters.collapsed;
+        spdlog::info("Edge collapse removed {} of {} edges ({:.1f}%)",
+                     collapsed,
+                     edges,
+                     edges == 0 ? 0.0 : 100.0 * static_cast<double>(collapsed) / edges);
     }
 
-    Eigen::MatrixXd all_features(total_atoms, topology::BETTI_FEATURE_DIM);
-    size_t row = 0;
-    for (const Eigen::MatrixXd& f : all_structure_features) {
-        all_features.middleRows(static_cast<int>(row), f.rows()) = f;
-        row += f.rows();
+    for (size_t c = 0; c < r_cutoffs.size(); c++) {
+        if (r_cutoffs.size() > 1) {
+            spdlog::info("Cutoff {}:", r_cutoffs[c]);
+        }
+        if (shard.sharded()) {
+            std::string moments_path =
+                std::format("{}/pca_moments{}.bin", output_paths[c], shard.suffix());
+            topology::save_moments(moments_path, pcas[c].moments());
+            spdlog::info(
+                "Saved PCA moments of {} atoms to {}", pcas[c].num_samples(), moments_path);
+        } else {
+            fit_pca(pcas[c], n_pca_components, output_paths[c] + "/pca_model.bin");
+            packs[c].finish();
+            spdlog::info("Packed {} structures into {}/betti.pack",
+                         structure_ids.size(),
+                         output_paths[c]);
+        }
     }
 
-    spdlog::info("Fitting PCA on {} atoms...", total_atoms);
-    topology::PCA pca;
-    pca.fit(all_features, n_pca_components);
-    pca.save(processed_path + "/pca_model.bin");
+    spdlog::info("Processed {} structures ({} up to date in the manifest, {} neighbor lists "
+                 "derived from their host)",
+                 structure_ids.size(),
+                 reused_count.load(),
+                 derived_count.load());
+}
 
-    spdlog::info("Processed {} structures", structure_ids.size());
-    spdlog::info("Total atoms: {}", all_features.rows());
-    spdlog::info("PCA explained variance ratio: {}", pca.explained_variance_ratio().sum());
+// Combines the PCA moments of all `num_shards` shards into pca_model.bin per cutoff and packs the
+// features they wrote. The moments are exact sums, so the model is bit for bit the one a single
+// process fits over the same structures.
+void merge_shards(const std::string& processed_path,
+                  unsigned num_shards,
+                  const std::vector<double>& r_cutoffs,
+                  int n_pca_components = 6) {
+    const std::vector<std::string> output_paths = cutoff_output_paths(processed_path, r_cutoffs);
+
+    for (size_t c = 0; c < r_cutoffs.size(); c++) {
+        topology::PCA pca;
+        for (unsigned i = 0; i < num_shards; i++) {
+            std::string moments_path = std::format(
+                "{}/pca_moments{}.bin", output_paths[c], Shard{i, num_shards}.suffix());
+            if (!fs::exists(moments_path)) {
+                throw std::runtime_error("Missing shard output: " + moments_path);
+            }
+            pca.merge(topology::load_moments(moments_path));
+        }
+
+        if (r_cutoffs.size() > 1) {
+            spdlog::info("Cutoff {}:", r_cutoffs[c]);
+        }
+        spdlog::info("Merged {} atoms from {} shards", pca.num_samples(), num_shards);
+        fit_pca(pca, n_pca_components, output_paths[c] + "/pca_model.bin");
+
+        pack_features(output_paths[c], stored_structure_ids(output_paths[c]));
+    }
 }
 
 }  // namespace defect_gnn::preprocess
@@ -114,34 +635,122 @@ int main(int argc, char** argv) {
     // Default paths
     std::string raw_path = "data/raw/defective_structures";
     std::string processed_path = "data/processed";
-    double r_cutoff = 10;
+    std::string r_cutoff_list = "10";
     int n_pca_components = 6;
-    unsigned num_threads = 8;
+    unsigned num_threads = std::max(1U, std::thread::hardware_concurrency());
+    defect_gnn::topology::PersistenceOptions persistence_options;
+    unsigned max_heavy_tasks = 0;
+    defect_gnn::preprocess::Shard shard;
+    defect_gnn::io::ArrayEncoding storage;
+    std::string dtype = "f64";
 
-    // Parse command line args (optional overrides)
-    if (argc >= 3) {
-        raw_path = argv[1];
-        processed_path = argv[2];
+    // "--threads N", "--edge-collapse", "--landmark-radius R", "--max-heavy K", "--shard i/N",
+    // "--dtype f64|f32|bf16" and "--compress" may appear anywhere; the rest are positional
+    // overrides. "--landmark-radius" trades accuracy for speed with no bound on the feature error;
+    // measure it with validate_approx first.
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            num_threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--dtype" && i + 1 < argc) {
+            dtype = argv[++i];
+            storage.dtype = defect_gnn::io::parse_dtype(dtype);
+        } else if (arg == "--compress") {
+            storage.codec = defect_gnn::io::Codec::SHUFFLE_DELTA;
+        } else if (arg == "--edge-collapse") {
+            persistence_options.collapse_edges = true;
+        } else if (arg == "--landmark-radius" && i + 1 < argc) {
+            persistence_options.landmark_radius = std::stod(argv[++i]);
+        } else if (arg == "--max-heavy" && i + 1 < argc) {
+            max_heavy_tasks = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--shard" && i + 1 < argc) {
+            shard = defect_gnn::preprocess::parse_shard(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
     }
-    if (argc >= 4) {
-        r_cutoff = std::stod(argv[3]);
+
+    // "pack <processed_path> [r_cutoff]" converts existing betti/*.bin outputs to betti.pack
+    if (!args.empty() && args[0] == "pack") {
+        if (args.size() < 2) {
+            spdlog::error("Usage: preprocess_betti pack <processed_path> [r_cutoff]");
+            return 1;
+        }
+        if (args.size() >= 3) {
+            r_cutoff_list = args[2];
+        }
+
+        defect_gnn::preprocess::pack_directory(
+            args[1], defect_gnn::preprocess::parse_cutoffs(r_cutoff_list));
+
+        spdlog::info("Done!");
+        return 0;
     }
-    if (argc >= 5) {
-        n_pca_components = std::stoi(argv[4]);
+
+    // "merge <processed_path> <num_shards> [r_cutoff] [pca]" combines the PCA moments of a sharded
+    // run into the models
+    if (!args.empty() && args[0] == "merge") {
+        if (args.size() < 3) {
+            spdlog::error("Usage: preprocess_betti merge <processed_path> <num_shards> [r_cutoff] "
+                          "[pca_components]");
+            return 1;
+        }
+        if (args.size() >= 4) {
+            r_cutoff_list = args[3];
+        }
+        if (args.size() >= 5) {
+            n_pca_components = std::stoi(args[4]);
+        }
+
+        defect_gnn::preprocess::merge_shards(args[1],
+                                             static_cast<unsigned>(std::stoul(args[2])),
+                                             defect_gnn::preprocess::parse_cutoffs(r_cutoff_list),
+                                             n_pca_components);
+
+        spdlog::info("Done!");
+        return 0;
     }
 
-    // Create output directories
-    fs::create_directories(processed_path + "/betti");
+    // Parse command line args (optional overrides)
+    if (args.size() >= 2) {
+        raw_path = args[0];
+        processed_path = args[1];
+    }
+    if (args.size() >= 3) {
+        r_cutoff_list = args[2];
+    }
+    if (args.size() >= 4) {
+        n_pca_components = std::stoi(args[3]);
+    }
 
     spdlog::info("Preprocessing Betti features...");
     spdlog::info("  Raw path: {}", raw_path);
     spdlog::info("  Output path: {}", processed_path);
-    spdlog::info("  r_cutoff: {}", r_cutoff);
+    spdlog::info("  r_cutoff: {}", r_cutoff_list);
     spdlog::info("  PCA components: {}", n_pca_components);
     spdlog::info("  Number of Threads: {}", num_threads);
+    spdlog::info("  Edge collapse: {}", persistence_options.collapse_edges);
+    spdlog::info("  Landmark radius: {}", persistence_options.landmark_radius);
+    if (persistence_options.landmark_radius > 0.0) {
+        spdlog::warn("Landmark features only bound the diagrams' bottleneck distance, not the "
+                     "features' error; check this radius with validate_approx");
+    }
+    spdlog::info("  Feature storage: {}, {}",
+                 dtype,
+                 storage.codec == defect_gnn::io::Codec::RAW ? "raw" : "shuffle+delta");
+    spdlog::info("  Shard: {}/{}", shard.index, shard.count);
 
     defect_gnn::preprocess::preprocess_all_structure(
-        raw_path, processed_path, r_cutoff, n_pca_components, num_threads);
+        raw_path,
+        processed_path,
+        defect_gnn::preprocess::parse_cutoffs(r_cutoff_list),
+        n_pca_components,
+        num_threads,
+        persistence_options,
+        max_heavy_tasks,
+        shard,
+        storage);
 
     spdlog::info("Done!");
     return 0;
@@ -0,0 +1,141 @@
+#include "crystal/structure.hpp"
+#include "graph/neighbor_list.hpp"
+#include "io/vasp_parser.hpp"
+#include "topology/betti_features.hpp"
+#include "topology/ripser_wrapper.hpp"
+#include "utils/logging.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace defect_gnn::preprocess {
+
+// Compares approximate Betti features against exact ones on an evenly spaced sample of
+// structures and logs the per-feature deviation and the speed-up. The landmark bound only holds
+// for the diagrams, so this is the only check on the features' error.
+void validate_approximation(const std::string& raw_path,
+                            double r_cutoff,
+                            const topology::PersistenceOptions& approx_options,
+                            size_t sample_size,
+                            unsigned num_threads) {
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(raw_path)) {
+        if (entry.path().extension() == ".vasp") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    if (files.empty()) {
+        throw std::runtime_error("No .vasp files found in " + raw_path);
+    }
+
+    size_t stride = std::max<size_t>(1, files.size() / std::max<size_t>(1, sample_size));
+
+    Eigen::VectorXd sum_abs = Eigen::VectorXd::Zero(topology::BETTI_FEATURE_DIM);
+    Eigen::VectorXd max_abs = Eigen::VectorXd::Zero(topology::BETTI_FEATURE_DIM);
+    Eigen::VectorXd sum_exact = Eigen::VectorXd::Zero(topology::BETTI_FEATURE_DIM);
+    double exact_seconds = 0.0;
+    double approx_seconds = 0.0;
+    size_t num_atoms = 0;
+    size_t num_structures = 0;
+
+    for (size_t f = 0; f < files.size() && num_structures < sample_size; f += stride) {
+        crystal::Structure structure(io::parse_vasp(files[f].string()));
+        graph::NeighborList neighbor_list(structure,
+                                          r_cutoff,
+                                          std::numeric_limits<size_t>::max(),
+                                          1e-10,
+                                          graph::NeighborBackend::KDTree,
+                                          num_threads);
+
+        auto start = std::chrono::steady_clock::now();
+        Eigen::MatrixXd exact = topology::compute_structure_betti_features(
+            structure, neighbor_list, r_cutoff, num_threads);
+        auto middle = std::chrono::steady_clock::now();
+        Eigen::MatrixXd approx = topology::compute_structure_betti_features(
+            structure, neighbor_list, r_cutoff, num_threads, nullptr, approx_options);
+        auto end = std::chrono::steady_clock::now();
+
+        exact_seconds += std::chrono::duration<double>(middle - start).count();
+        approx_seconds += std::chrono::duration<double>(end - middle).count();
+
+        Eigen::MatrixXd deviation = (approx - exact).cwiseAbs();
+        sum_abs += deviation.colwise().sum().transpose();
+        max_abs = max_abs.cwiseMax(deviation.colwise().maxCoeff().transpose());
+        sum_exact += exact.cwiseAbs().colwise().sum().transpose();
+
+        num_atoms += structure.num_atoms();
+        num_structures++;
+        spdlog::info("  {}: {} atoms", files[f].stem().string(), structure.num_atoms());
+    }
+
+    spdlog::info(
+        "{:<28} {:>12} {:>12} {:>12}", "feature", "mean |exact|", "mean |dev|", "max |dev|");
+    for (int k = 0; k < topology::BETTI_FEATURE_DIM; k++) {
+        spdlog::info("{:<28} {:>12.6f} {:>12.6f} {:>12.6f}",
+                     topology::betti_feature_name(k),
+                     sum_exact[k] / static_cast<double>(num_atoms),
+                     sum_abs[k] / static_cast<double>(num_atoms),
+                     max_abs[k]);
+    }
+
+    spdlog::info("Sample: {} structures, {} atoms", num_structures, num_atoms);
+    spdlog::info("Exact: {:.3f}s, approximate: {:.3f}s ({:.1f}x)",
+                 exact_seconds,
+                 approx_seconds,
+                 approx_seconds > 0.0 ? exact_seconds / approx_seconds : 0.0);
+}
+
+}  // namespace defect_gnn::preprocess
+
+int main(int argc, char** argv) {
+    defect_gnn::utils::init_logger("validate_approx");
+
+    if (argc < 4) {
+        spdlog::error("Usage: {} <raw_path> <r_cutoff> <landmark_radius> [sample_size] "
+                      "[--edge-collapse] [--threads N]",
+                      argv[0]);
+        return 1;
+    }
+
+    std::string raw_path = argv[1];
+    double r_cutoff = std::stod(argv[2]);
+    defect_gnn::topology::PersistenceOptions options;
+    options.landmark_radius = std::stod(argv[3]);
+    size_t sample_size = 20;
+    unsigned num_threads = std::max(1U, std::thread::hardware_concurrency());
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--edge-collapse") {
+            options.collapse_edges = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            num_threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else {
+            sample_size = std::stoul(arg);
+        }
+    }
+
+    spdlog::info("Validating approximate Betti features...");
+    spdlog::info("  Raw path: {}", raw_path);
+    spdlog::info("  r_cutoff: {}", r_cutoff);
+    spdlog::info("  Landmark radius: {}", options.landmark_radius);
+    spdlog::info("  Edge collapse: {}", options.collapse_edges);
+
+    defect_gnn::preprocess::validate_approximation(
+        raw_path, r_cutoff, options, sample_size, num_threads);
+
+    return 0;
+}
@@ -1,24 +1,31 @@
 #include "topology/betti_features.hpp"
 
 #include "crystal/structure.hpp"
+#include "crystal/symmetry.hpp"
 #include "graph/neighbor_list.hpp"
+#include "io/binary_format.hpp"
+#include "topology/feature_cache.hpp"
 #include "topology/ripser_wrapper.hpp"
 #include "utils/math.hpp"
+#include "utils/task_scheduler.hpp"
 
 #include <Eigen/Dense>
 
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstddef>
-#include <fstream>
-#include <ios>
+#include <cstdint>
 #include <limits>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
-#ifdef _OPENMP
-    #include <omp.h>
-#endif
-
 namespace defect_gnn::topology {
 
 BettiStatistics compute_statistics(const PersistenceDiagram& diagram,
@@ -54,101 +61,413 @@ BettiStatistics compute_statistics(const PersistenceDiagram& diagram,
             utils::weighted_sum(eigen_values, weight)};
 }
 
-Eigen::VectorXd compute_atom_betti_features(const crystal::Structure& structure,
-                                            size_t atom_idx,
-                                            const graph::NeighborList& neighbor_list,
-                                            double r_cutoff,
-                                            unsigned num_threads) {
-    auto center_element = structure.atoms()[atom_idx];
-    int element_count = structure.count(center_element.element);
+namespace {
+
+// Feature layout: one block of statistics per (diagram, pair value), in this order
+enum FeatureBlock : int {
+    DIM0_DEATH,
+    DIM1_PERSISTENCE,
+    DIM1_BIRTH,
+    DIM1_DEATH,
+    DIM2_PERSISTENCE,
+    DIM2_BIRTH,
+    DIM2_DEATH,
+    NUM_FEATURE_BLOCKS
+};
+
+// Statistics within a block; only the weighted sum depends on the weight
+enum BlockStatistic : int { MEAN, STD, MAX, MIN, WEIGHTED_SUM };
+constexpr int STATS_PER_BLOCK = WEIGHTED_SUM + 1;
+
+static_assert(NUM_FEATURE_BLOCKS * STATS_PER_BLOCK == BETTI_FEATURE_DIM,
+              "Betti feature layout does not match BETTI_FEATURE_DIM");
+
+enum PairValue : int { PERSISTENCE, BIRTH, DEATH, NUM_PAIR_VALUES };
+
+// Neighborhoods at least this large give Ripser enough columns for its own reduction threads to
+// pay off; smaller ones run single-threaded, spread across atoms
+constexpr size_t INNER_PARALLEL_MIN_NEIGHBORS = 192;
+
+// Estimated cost (see estimate_persistence_cost) from which a scheduled atom counts as heavy and
+// waits for one of the scheduler's heavy slots; about half a second of single-threaded Ripser, a
+// dense neighborhood of roughly INNER_PARALLEL_MIN_NEIGHBORS points
+constexpr double HEAVY_PERSISTENCE_COST = 4e6;
+
+// Scratch column length, padded so every column starts on an Eigen-aligned boundary
+constexpr size_t ALIGNED_DOUBLES = EIGEN_MAX_ALIGN_BYTES / sizeof(double);
+
+// Writes the statistics of `values` over the finite pairs of `diagram` into consecutive blocks
+// starting at `first_block`. One pass over the diagram fills per-value columns of a per-thread
+// scratch buffer and tracks max/min; mean, std and sum run the same Eigen reductions as
+// compute_statistics on equally aligned data, so the results match it bit for bit.
+void diagram_statistics(const PersistenceDiagram& diagram,
+                        std::span<const PairValue> values,
+                        FeatureBlock first_block,
+                        double weight,
+                        Eigen::VectorXd& atom_features) {
+    using AlignedVector = std::vector<double, Eigen::aligned_allocator<double>>;
+    thread_local AlignedVector scratch;
+
+    const size_t stride =
+        (diagram.size() + ALIGNED_DOUBLES - 1) / ALIGNED_DOUBLES * ALIGNED_DOUBLES;
+    if (scratch.size() < stride * NUM_PAIR_VALUES) {
+        scratch.resize(stride * NUM_PAIR_VALUES);
+    }
 
-    const auto& neighbors = neighbor_list.neighbors(atom_idx);
+    std::array<double, NUM_PAIR_VALUES> max_value;
+    std::array<double, NUM_PAIR_VALUES> min_value;
+    max_value.fill(-INFINITY);
+    min_value.fill(INFINITY);
 
-    Eigen::MatrixXd point_cloud(static_cast<Eigen::Index>(neighbors.size() + 1), 3);
-    point_cloud.row(0) = center_element.position.transpose();
+    size_t count = 0;
+    for (const PersistencePair& pair : diagram) {
+        if (pair.death == INFINITY) {
+            continue;
+        }
 
-    for (size_t i = 0; i < neighbors.size(); i++) {
-        point_cloud.row(static_cast<Eigen::Index>(i + 1)) =
-            (center_element.position + neighbors[i].displacement).transpose();
+        const std::array<double, NUM_PAIR_VALUES> value = {
+            persistence(pair), pair.birth, pair.death};
+        for (PairValue v : values) {
+            scratch[v * stride + count] = value[v];
+            max_value[v] = std::max(max_value[v], value[v]);
+            min_value[v] = std::min(min_value[v], value[v]);
+        }
+        count++;
     }
 
-    PersistenceResult result = topology::compute_persistence(point_cloud, r_cutoff, num_threads);
+    int idx = first_block * STATS_PER_BLOCK;
+    for (PairValue v : values) {
+        if (count == 0) {
+            atom_features.segment(idx, STATS_PER_BLOCK).setZero();
+        } else {
+            Eigen::Map<const Eigen::VectorXd, Eigen::AlignedMax> column(
+                scratch.data() + v * stride, static_cast<Eigen::Index>(count));
+
+            atom_features[idx + MEAN] = utils::mean(column);
+            atom_features[idx + STD] = utils::std(column);
+            atom_features[idx + MAX] = max_value[v];
+            atom_features[idx + MIN] = min_value[v];
+            atom_features[idx + WEIGHTED_SUM] = utils::weighted_sum(column, weight);
+        }
+        idx += STATS_PER_BLOCK;
+    }
+}
 
-    double weight = 1.0 / element_count;
+Eigen::VectorXd neighborhood_betti_features(const graph::NeighborView<double>& neighbors,
+                                            double r_cutoff,
+                                            unsigned num_threads,
+                                            double weight,
+                                            const PersistenceOptions& options) {
+    PersistenceResult result =
+        topology::compute_neighborhood_persistence(neighbors, r_cutoff, num_threads, options);
+
+    // Ripser lists pairs in an order that follows the neighbor order. Sorting makes the statistics
+    // a function of the diagrams alone, so congruent neighborhoods give identical rows.
+    for (PersistenceDiagram* diagram : {&result.dim0, &result.dim1, &result.dim2}) {
+        std::sort(diagram->begin(), diagram->end(), [](const auto& a, const auto& b) {
+            return std::tie(a.birth, a.death) < std::tie(b.birth, b.death);
+        });
+    }
 
     Eigen::VectorXd atom_features(BETTI_FEATURE_DIM);
 
-    int idx = 0;
-    auto append = [&](const BettiStatistics& s) {
-        atom_features.segment(idx, 5) << s.mean, s.std, s.max, s.min, s.weighted_sum;
-        idx += 5;
-    };
+    // 5 features for dim0 from death only; 15 each for dim1 and dim2 from persistence, birth,
+    // and death
+    constexpr std::array<PairValue, 1> DEATH_ONLY = {DEATH};
+    constexpr std::array<PairValue, 3> ALL_VALUES = {PERSISTENCE, BIRTH, DEATH};
+
+    diagram_statistics(result.dim0, DEATH_ONLY, DIM0_DEATH, weight, atom_features);
+    diagram_statistics(result.dim1, ALL_VALUES, DIM1_PERSISTENCE, weight, atom_features);
+    diagram_statistics(result.dim2, ALL_VALUES, DIM2_PERSISTENCE, weight, atom_features);
+
+    return atom_features;
+}
 
-    // 5 Features for dim0 from death only
-    append(compute_statistics(result.dim0, "death", weight));
+// The cache holds rows computed with weight 1. weighted_sum is sum * weight, so scaling those
+// entries afterwards gives the same bits as computing with the weight directly.
+void apply_weight(Eigen::VectorXd& atom_features, double weight) {
+    for (int idx = WEIGHTED_SUM; idx < BETTI_FEATURE_DIM; idx += STATS_PER_BLOCK) {
+        atom_features[idx] *= weight;
+    }
+}
 
-    // 15 features for dim1 from persistence, birth, and death
-    for (const char* type : {"persistence", "birth", "death"}) {
-        append(compute_statistics(result.dim1, type, weight));
+Eigen::VectorXd cached_atom_betti_features(const crystal::Structure& structure,
+                                           size_t atom_idx,
+                                           const graph::NeighborList& neighbor_list,
+                                           double r_cutoff,
+                                           unsigned num_threads,
+                                           FeatureCache& cache,
+                                           const PersistenceOptions& options) {
+    graph::NeighborView<double> neighbors = neighbor_list.neighbors(atom_idx);
+
+    std::vector<int> species;
+    species.reserve(neighbors.size() + 1);
+    species.push_back(structure.element(atom_idx));
+    for (uint32_t j : neighbors.indices) {
+        species.push_back(structure.element(j));
     }
 
-    // 15 features for dim2 from persistence, birth, and death
-    for (const char* type : {"persistence", "birth", "death"}) {
-        append(compute_statistics(result.dim2, type, weight));
+    EnvironmentKey key =
+        fingerprint_environment(neighbors, species, r_cutoff, options.landmark_radius);
+
+    std::optional<Eigen::VectorXd> atom_features = cache.find(key);
+    if (!atom_features) {
+        atom_features =
+            neighborhood_betti_features(neighbors, r_cutoff, num_threads, 1.0, options);
+        cache.insert(key, *atom_features);
     }
 
-    return atom_features;
+    apply_weight(*atom_features, 1.0 / structure.count(structure.element(atom_idx)));
+
+    return *atom_features;
+}
+
+}  // namespace
+
+std::string betti_feature_name(int index) {
+    if (index < 0 || index >= BETTI_FEATURE_DIM) {
+        throw std::runtime_error("Betti feature index out of range: " + std::to_string(index));
+    }
+
+    static constexpr std::array<const char*, NUM_FEATURE_BLOCKS> BLOCK_NAMES = {
+        "dim0 death",
+        "dim1 persistence",
+        "dim1 birth",
+        "dim1 death",
+        "dim2 persistence",
+        "dim2 birth",
+        "dim2 death"};
+    static constexpr std::array<const char*, STATS_PER_BLOCK> STAT_NAMES = {
+        "mean", "std", "max", "min", "weighted_sum"};
+
+    return std::string(BLOCK_NAMES[index / STATS_PER_BLOCK]) + " " +
+           STAT_NAMES[index % STATS_PER_BLOCK];
+}
+
+Eigen::VectorXd compute_atom_betti_features(const crystal::Structure& structure,
+                                            size_t atom_idx,
+                                            const graph::NeighborList& neighbor_list,
+                                            double r_cutoff,
+                                            unsigned num_threads,
+                                            const PersistenceOptions& options) {
+    int element_count = structure.count(structure.element(atom_idx));
+
+    return neighborhood_betti_features(neighbor_list.neighbors(atom_idx),
+                                       r_cutoff,
+                                       num_threads,
+                                       1.0 / element_count,
+                                       options);
 }
 
 Eigen::MatrixXd compute_structure_betti_features(const crystal::Structure& structure,
                                                  double r_cutoff,
-                                                 unsigned num_threads) {
+                                                 unsigned num_threads,
+                                                 FeatureCache* cache,
+                                                 const PersistenceOptions& options) {
+    graph::NeighborList neighbor_list(structure,
+                                      r_cutoff,
+                                      std::numeric_limits<size_t>::max(),
+                                      1e-10,
+                                      graph::NeighborBackend::KDTree,
+                                      num_threads);
+
+    return compute_structure_betti_features(
+        structure, neighbor_list, r_cutoff, num_threads, cache, options);
+}
+
+namespace {
+
+// Every pairwise length of the center and its neighbors, computed as the persistence computation
+// does and sorted: the filtration's values, independent of the neighbor order
+std::vector<double> sorted_pair_lengths(const graph::NeighborView<double>& neighbors) {
+    const size_t num_neighbors = neighbors.size();
+    std::vector<double> lengths(neighbors.distances.begin(), neighbors.distances.end());
+    lengths.reserve(num_neighbors * (num_neighbors + 1) / 2);
+
+    for (size_t k = 0; k < num_neighbors; k++) {
+        for (size_t l = k + 1; l < num_neighbors; l++) {
+            double dx = neighbors.dx[l] - neighbors.dx[k];
+            double dy = neighbors.dy[l] - neighbors.dy[k];
+            double dz = neighbors.dz[l] - neighbors.dz[k];
+            lengths.push_back(std::sqrt(dx * dx + dy * dy + dz * dz));
+        }
+    }
+    std::sort(lengths.begin(), lengths.end());
+    return lengths;
+}
+
+// For each atom, the atom whose row it takes: its orbit representative when the two neighborhoods
+// have bit-identical lengths, otherwise the atom itself. Symmetry is found within a tolerance, so
+// equivalent neighborhoods can differ in the last bits and then each computes its own row.
+// Landmark selection follows the neighbor order, which the symmetry permutes, so with landmarks
+// every atom computes its own row.
+std::vector<size_t> row_sources(const std::vector<size_t>& orbit,
+                                const graph::NeighborList& neighbor_list,
+                                const PersistenceOptions& options) {
+    std::vector<size_t> source(orbit.size());
+    std::vector<std::vector<double>> representative_lengths(orbit.size());
+
+    for (size_t i = 0; i < orbit.size(); i++) {
+        const size_t r = orbit[i];
+        source[i] = i;
+        if (r == i || options.landmark_radius > 0.0) {
+            continue;
+        }
+
+        graph::NeighborView<double> own = neighbor_list.neighbors(i);
+        graph::NeighborView<double> theirs = neighbor_list.neighbors(r);
+        if (!std::equal(own.distances.begin(),
+                        own.distances.end(),
+                        theirs.distances.begin(),
+                        theirs.distances.end())) {
+            continue;
+        }
+
+        if (representative_lengths[r].empty()) {
+            representative_lengths[r] = sorted_pair_lengths(theirs);
+        }
+        if (sorted_pair_lengths(own) == representative_lengths[r]) {
+            source[i] = r;
+        }
+    }
+    return source;
+}
+
+Eigen::MatrixXd orbit_betti_features(const crystal::Structure& structure,
+                                     const graph::NeighborList& neighbor_list,
+                                     const std::vector<size_t>& orbit,
+                                     double r_cutoff,
+                                     unsigned num_threads,
+                                     FeatureCache* cache,
+                                     const PersistenceOptions& options,
+                                     utils::TaskScheduler* scheduler) {
     Eigen::MatrixXd structure_features(structure.num_atoms(), BETTI_FEATURE_DIM);
-    graph::NeighborList neighbor_list(structure, r_cutoff, std::numeric_limits<size_t>::max());
 
-    int num_atoms = static_cast<int>(structure.num_atoms());
+    const std::vector<size_t> source = row_sources(orbit, neighbor_list, options);
+    std::vector<size_t> representatives;
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] == i) {
+            representatives.push_back(i);
+        }
+    }
+
+    auto fill_row = [&](size_t i, unsigned inner_threads) {
+        Eigen::VectorXd atom_features =
+            cache ? cached_atom_betti_features(
+                        structure, i, neighbor_list, r_cutoff, inner_threads, *cache, options)
+                  : compute_atom_betti_features(
+                        structure, i, neighbor_list, r_cutoff, inner_threads, options);
+        structure_features.row(static_cast<Eigen::Index>(i)) = atom_features;
+    };
+
+    // Ripser threads go only to neighborhoods large enough to use them
+    auto make_tasks = [&](unsigned inner_threads) {
+        std::vector<utils::TaskScheduler::Task> tasks;
+        tasks.reserve(representatives.size());
+        for (size_t i : representatives) {
+            graph::NeighborView<double> neighbors = neighbor_list.neighbors(i);
+            double cost = estimate_persistence_cost(neighbors, r_cutoff);
+            bool heavy = cost >= HEAVY_PERSISTENCE_COST;
+            unsigned threads = neighbors.size() >= INNER_PARALLEL_MIN_NEIGHBORS ? inner_threads : 1;
+            tasks.push_back({cost, heavy, [&fill_row, i, threads] { fill_row(i, threads); }});
+        }
+        return tasks;
+    };
 
-#pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < num_atoms; i++) {
-        Eigen::VectorXd atom_features = compute_atom_betti_features(
-            structure, static_cast<size_t>(i), neighbor_list, r_cutoff, num_threads);
-        structure_features.row(i) = atom_features;
+    if (scheduler) {
+        scheduler->run_batch(make_tasks(1));
+    } else {
+        if (num_threads == 0) {
+            num_threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+
+        // A pool of its own, balanced longest-first like the pipeline's. With fewer representatives
+        // than threads the spare ones go to Ripser, so workers times Ripser threads stays within
+        // num_threads. Nothing else shares the pool, so heavy atoms are not capped.
+        auto num_workers = static_cast<unsigned>(
+            std::clamp<size_t>(representatives.size(), 1, num_threads));
+        utils::TaskScheduler local(num_workers, num_workers);
+        local.run_batch(make_tasks(num_threads / num_workers));
+    }
+
+    for (size_t i = 0; i < source.size(); i++) {
+        if (source[i] != i) {
+            structure_features.row(static_cast<Eigen::Index>(i)) =
+                structure_features.row(static_cast<Eigen::Index>(source[i]));
+        }
     }
 
     return structure_features;
 }
 
-void save_betti_features(const std::string& filepath, const Eigen::MatrixXd& features) {
-    std::ofstream file(filepath, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file for writing: " + filepath);
-    }
-
-    int rows = static_cast<int>(features.rows());
-    int cols = static_cast<int>(features.cols());
+}  // namespace
 
-    file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
-    file.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
-    file.write(reinterpret_cast<const char*>(features.data()),
-               static_cast<std::streamsize>(static_cast<size_t>(rows) * cols * sizeof(double)));
+Eigen::MatrixXd compute_structure_betti_features(const crystal::Structure& structure,
+                                                 const graph::NeighborList& neighbor_list,
+                                                 double r_cutoff,
+                                                 unsigned num_threads,
+                                                 FeatureCache* cache,
+                                                 const PersistenceOptions& options) {
+    return orbit_betti_features(structure,
+                                neighbor_list,
+                                crystal::find_equivalent_atoms(structure),
+                                r_cutoff,
+                                num_threads,
+                                cache,
+                                options,
+                                nullptr);
 }
 
-Eigen::MatrixXd load_betti_features(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file for reading: " + filepath);
-    }
+// Persistence cannot be reused across cutoffs: a smaller cutoff drops points from the cloud, not
+// only edges from the filtration. What is shared is the neighbor search and the symmetry orbits.
+std::vector<Eigen::MatrixXd>
+compute_structure_betti_features(const crystal::Structure& structure,
+                                 const graph::NeighborList& neighbor_list,
+                                 std::span<const double> r_cutoffs,
+                                 unsigned num_threads,
+                                 FeatureCache* cache,
+                                 const PersistenceOptions& options,
+                                 utils::TaskScheduler* scheduler) {
+    const std::vector<size_t> orbits = crystal::find_equivalent_atoms(structure);
+
+    std::vector<Eigen::MatrixXd> features;
+    features.reserve(r_cutoffs.size());
+
+    for (double r_cutoff : r_cutoffs) {
+        if (r_cutoff == neighbor_list.r_cutoff()) {
+            features.push_back(orbit_betti_features(structure,
+                                                    neighbor_list,
+                                                    orbits,
+                                                    r_cutoff,
+                                                    num_threads,
+                                                    cache,
+                                                    options,
+                                                    scheduler));
+            continue;
+        }
 
-    int rows = 0;
-    int cols = 0;
+        graph::NeighborList cutoff_list =
+            neighbor_list.filtered(r_cutoff, std::numeric_limits<size_t>::max());
+        features.push_back(orbit_betti_features(
+            structure, cutoff_list, orbits, r_cutoff, num_threads, cache, options, scheduler));
+    }
 
-    file.read(reinterpret_cast<char*>(&rows), sizeof(rows));
-    file.read(reinterpret_cast<char*>(&cols), sizeof(cols));
+    return features;
+}
 
-    Eigen::MatrixXd features(rows, cols);
-    file.read(reinterpret_cast<char*>(features.data()),
-              static_cast<std::streamsize>(static_cast<size_t>(rows) * cols * sizeof(double)));
+void save_betti_features(const std::string& filepath,
+                         const Eigen::MatrixXd& features,
+                         io::ArrayEncoding encoding) {
+    io::ArrayWriter writer(encoding);
+    writer.add(features);
+    writer.save(filepath);
+}
 
+Eigen::MatrixXd load_betti_features(const std::string& filepath) {
+    Eigen::MatrixXd features = std::move(io::read_arrays(filepath, 1).front());
+    if (features.cols() != BETTI_FEATURE_DIM) {
+        throw std::runtime_error("Unexpected Betti feature width in " + filepath);
+    }
     return features;
 }
 
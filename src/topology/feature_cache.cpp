@@ -0,0 +1,178 @@
+#include "topology/feature_cache.hpp"
+
+#include "graph/neighbor_list.hpp"
+#include "topology/betti_features.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace defect_gnn::topology {
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Two independent 64-bit streams over the same values
+class KeyBuilder {
+public:
+    void add(int64_t value) {
+        auto v = static_cast<uint64_t>(value);
+        key_.hash = (key_.hash ^ v) * 0x100000001B3ULL;
+        key_.check = splitmix64(key_.check ^ v);
+    }
+
+    [[nodiscard]] EnvironmentKey key() const {
+        return {splitmix64(key_.hash), key_.check};
+    }
+
+private:
+    EnvironmentKey key_{0xCBF29CE484222325ULL, 0x2545F4914F6CDD1DULL};
+};
+
+}  // namespace
+
+EnvironmentKey fingerprint_environment(const graph::NeighborView<double>& neighbors,
+                                       std::span<const int> species,
+                                       double threshold,
+                                       double landmark_radius,
+                                       double resolution) {
+    auto quantize = [resolution](double d) { return std::llround(d / resolution); };
+    const size_t num_neighbors = neighbors.size();
+
+    std::vector<std::pair<int64_t, int>> center_shell;
+    center_shell.reserve(num_neighbors);
+    for (size_t k = 0; k < num_neighbors; k++) {
+        center_shell.emplace_back(quantize(neighbors.distances[k]), species[k + 1]);
+    }
+    std::sort(center_shell.begin(), center_shell.end());
+
+    // Only edges inside the threshold enter the Rips filtration
+    std::vector<int64_t> edges;
+    for (size_t k = 0; k < num_neighbors; k++) {
+        for (size_t l = k + 1; l < num_neighbors; l++) {
+            double dx = neighbors.dx[l] - neighbors.dx[k];
+            double dy = neighbors.dy[l] - neighbors.dy[k];
+            double dz = neighbors.dz[l] - neighbors.dz[k];
+            double d = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if (d <= threshold) {
+                edges.push_back(quantize(d));
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    KeyBuilder builder;
+    builder.add(quantize(threshold));
+    if (landmark_radius > 0.0) {
+        builder.add(quantize(landmark_radius));  // exact runs keep their existing keys
+    }
+    builder.add(species.empty() ? -1 : species[0]);
+    builder.add(static_cast<int64_t>(center_shell.size()));
+    for (const auto& [d, s] : center_shell) {
+        builder.add(d);
+        builder.add(s);
+    }
+    builder.add(static_cast<int64_t>(edges.size()));
+    for (int64_t d : edges) {
+        builder.add(d);
+    }
+
+    return builder.key();
+}
+
+std::optional<Eigen::VectorXd> FeatureCache::find(const EnvironmentKey& key) const {
+    std::shared_lock lock(mutex_);
+
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        misses_++;
+        return std::nullopt;
+    }
+
+    hits_++;
+    return it->second;
+}
+
+void FeatureCache::insert(const EnvironmentKey& key, const Eigen::VectorXd& features) {
+    std::unique_lock lock(mutex_);
+    entries_.try_emplace(key, features);
+}
+
+size_t FeatureCache::size() const {
+    std::shared_lock lock(mutex_);
+    return entries_.size();
+}
+
+// Layout: int64 entry count, int feature dim, then per entry the two key words and the row
+void FeatureCache::save(const std::string& filepath) const {
+    std::shared_lock lock(mutex_);
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for writing: " + filepath);
+    }
+
+    auto count = static_cast<int64_t>(entries_.size());
+    int dim = BETTI_FEATURE_DIM;
+
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+
+    for (const auto& [key, features] : entries_) {
+        file.write(reinterpret_cast<const char*>(&key.hash), sizeof(key.hash));
+        file.write(reinterpret_cast<const char*>(&key.check), sizeof(key.check));
+        file.write(reinterpret_cast<const char*>(features.data()),
+                   static_cast<std::streamsize>(dim * sizeof(double)));
+    }
+}
+
+void FeatureCache::load(const std::string& filepath) {
+    std::ifstream file(filepath, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file for reading: " + filepath);
+    }
+
+    int64_t count = 0;
+    int dim = 0;
+
+    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    file.read(reinterpret_cast<char*>(&dim), sizeof(dim));
+
+    if (!file || count < 0 || dim != BETTI_FEATURE_DIM) {
+        throw std::runtime_error("Invalid feature cache file: " + filepath);
+    }
+
+    std::unique_lock lock(mutex_);
+
+    for (int64_t e = 0; e < count; e++) {
+        EnvironmentKey key;
+        Eigen::VectorXd features(dim);
+
+        file.read(reinterpret_cast<char*>(&key.hash), sizeof(key.hash));
+        file.read(reinterpret_cast<char*>(&key.check), sizeof(key.check));
+        file.read(reinterpret_cast<char*>(features.data()),
+                  static_cast<std::streamsize>(dim * sizeof(double)));
+
+        if (!file) {
+            throw std::runtime_error("Truncated feature cache file: " + filepath);
+        }
+
+        entries_.try_emplace(key, std::move(features));
+    }
+}
+
+}  // namespace defect_gnn::topology
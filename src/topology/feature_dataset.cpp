@@ -0,0 +1,195 @@
+#include "topology/feature_dataset.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <ios>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace defect_gnn::topology {
+
+namespace {
+
+constexpr std::array<char, 8> MAGIC = {'D', 'G', 'N', 'N', 'P', 'A', 'C', 'K'};
+constexpr uint32_t VERSION = 1;
+
+struct FileHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t cols;
+    uint64_t num_structures;
+    uint64_t index_offset;
+    uint64_t id_table_offset;
+    std::array<char, 24> reserved;
+};
+
+static_assert(sizeof(FileHeader) == FEATURE_DATASET_ALIGNMENT);
+
+uint64_t align_up(uint64_t offset) {
+    return (offset + FEATURE_DATASET_ALIGNMENT - 1) / FEATURE_DATASET_ALIGNMENT *
+           FEATURE_DATASET_ALIGNMENT;
+}
+
+}  // namespace
+
+FeatureDatasetWriter::FeatureDatasetWriter(std::string filepath)
+    : filepath_(std::move(filepath)), temp_path_(filepath_ + ".tmp") {
+    file_.open(temp_path_, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        throw std::runtime_error("Cannot open file for writing: " + temp_path_);
+    }
+
+    FileHeader placeholder{};
+    file_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+    end_ = sizeof(placeholder);
+}
+
+void FeatureDatasetWriter::add(const std::string& id, const Eigen::MatrixXd& features) {
+    if (entries_.empty()) {
+        cols_ = static_cast<uint64_t>(features.cols());
+    } else if (static_cast<uint64_t>(features.cols()) != cols_) {
+        throw std::runtime_error("Feature matrix of " + id + " has a different column count");
+    }
+
+    const uint64_t offset = align_up(end_);
+    const std::array<char, FEATURE_DATASET_ALIGNMENT> zeros{};
+    file_.write(zeros.data(), static_cast<std::streamsize>(offset - end_));
+
+    const auto size = static_cast<uint64_t>(features.size()) * sizeof(double);
+    file_.write(reinterpret_cast<const char*>(features.data()), static_cast<std::streamsize>(size));
+    end_ = offset + size;
+
+    entries_.push_back(
+        {offset, static_cast<uint64_t>(features.rows()), id_table_.size(), id.size()});
+    id_table_ += id;
+}
+
+void FeatureDatasetWriter::finish() {
+    FileHeader header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.cols = static_cast<uint32_t>(cols_);
+    header.num_structures = entries_.size();
+    header.index_offset = align_up(end_);
+    header.id_table_offset = header.index_offset + entries_.size() * sizeof(Entry);
+
+    const std::array<char, FEATURE_DATASET_ALIGNMENT> zeros{};
+    file_.write(zeros.data(), static_cast<std::streamsize>(header.index_offset - end_));
+    file_.write(reinterpret_cast<const char*>(entries_.data()),
+                static_cast<std::streamsize>(entries_.size() * sizeof(Entry)));
+    file_.write(id_table_.data(), static_cast<std::streamsize>(id_table_.size()));
+
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.close();
+    if (!file_) {
+        throw std::runtime_error("Failed to write feature dataset: " + temp_path_);
+    }
+
+    std::filesystem::rename(temp_path_, filepath_);
+}
+
+FeatureDataset::FeatureDataset(const std::string& filepath) : filepath_(filepath) {
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file for reading: " + filepath);
+    }
+
+    struct stat info {};
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("Invalid feature dataset file: " + filepath);
+    }
+    file_size_ = static_cast<size_t>(info.st_size);
+
+    void* mapping = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Cannot map file: " + filepath);
+    }
+    data_ = static_cast<const char*>(mapping);
+
+    FileHeader header{};
+    std::memcpy(&header, data_, sizeof(header));
+
+    const uint64_t index_size = header.num_structures * sizeof(Entry);
+    bool valid = header.magic == MAGIC && header.version == VERSION &&
+                 header.index_offset % alignof(Entry) == 0 &&
+                 header.num_structures <= file_size_ / sizeof(Entry) &&
+                 header.index_offset <= file_size_ - index_size &&
+                 header.id_table_offset == header.index_offset + index_size;
+
+    num_structures_ = valid ? header.num_structures : 0;
+    cols_ = header.cols;
+    index_ = data_ + header.index_offset;
+    id_table_ = data_ + header.id_table_offset;
+    lookup_.reserve(num_structures_);
+
+    // Every payload and id must lie inside the file, so the views never read past the mapping
+    const uint64_t row_bytes = std::max<uint64_t>(header.cols, 1) * sizeof(double);
+    for (size_t i = 0; i < num_structures_ && valid; i++) {
+        Entry e = entry(i);
+        valid = e.offset % FEATURE_DATASET_ALIGNMENT == 0 && e.offset <= file_size_ &&
+                e.rows <= (file_size_ - e.offset) / row_bytes &&
+                e.id_offset <= file_size_ - header.id_table_offset &&
+                e.id_length <= file_size_ - header.id_table_offset - e.id_offset &&
+                lookup_.emplace(id(i), i).second;
+    }
+
+    if (!valid) {
+        ::munmap(const_cast<char*>(data_), file_size_);
+        throw std::runtime_error("Invalid feature dataset file: " + filepath);
+    }
+}
+
+FeatureDataset::~FeatureDataset() {
+    ::munmap(const_cast<char*>(data_), file_size_);
+}
+
+FeatureDataset::Entry FeatureDataset::entry(size_t i) const {
+    Entry e{};
+    std::memcpy(&e, index_ + i * sizeof(Entry), sizeof(Entry));
+    return e;
+}
+
+std::string_view FeatureDataset::id(size_t i) const {
+    Entry e = entry(i);
+    return {id_table_ + e.id_offset, e.id_length};
+}
+
+std::optional<size_t> FeatureDataset::find(std::string_view id) const {
+    auto it = lookup_.find(id);
+    if (it == lookup_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+FeatureView FeatureDataset::features(size_t i) const {
+    Entry e = entry(i);
+    return {reinterpret_cast<const double*>(data_ + e.offset),
+            static_cast<Eigen::Index>(e.rows),
+            cols_};
+}
+
+FeatureView FeatureDataset::features(std::string_view id) const {
+    std::optional<size_t> i = find(id);
+    if (!i) {
+        throw std::runtime_error("Structure " + std::string(id) + " not in " + filepath_);
+    }
+    return features(*i);
+}
+
+}  // namespace defect_gnn::topology
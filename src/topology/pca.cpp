@@ -1,30 +1,192 @@
 #include "topology/pca.hpp"
 
-#include "Eigen/src/Core/util/Constants.h"
-#include "Eigen/src/SVD/JacobiSVD.h"
+#include "io/binary_format.hpp"
 #include "topology/betti_features.hpp"
 
 #include <Eigen/Dense>
 
-#include <fstream>
-#include <ios>
+#include <algorithm>
+#include <cstddef>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace defect_gnn::topology {
 
 void PCA::fit(const Eigen::MatrixXd& x, int n_components) {
+    moments_ = {};
+    partial_fit(x);
+    finalize(n_components);
+}
+
+PCAMoments compute_moments(const Eigen::MatrixXd& x) {
     if (x.cols() != BETTI_FEATURE_DIM) {
         throw std::runtime_error("Inputted Matrix does not have the correct number of columns");
     }
+    if (x.rows() == 0) {
+        return {};
+    }
 
-    mean_ = x.colwise().mean();
-    Eigen::MatrixXd centered = x.rowwise() - mean_.transpose();
+    const auto dim = static_cast<size_t>(x.cols());
+    PCAMoments moments;
+    moments.count = static_cast<size_t>(x.rows());
+    moments.sums.resize(dim);
+    moments.products.resize(dim * (dim + 1) / 2);
+
+    std::vector<double> row(dim);
+    for (Eigen::Index r = 0; r < x.rows(); r++) {
+        Eigen::VectorXd::Map(row.data(), x.cols()) = x.row(r).transpose();
+
+        size_t pair = 0;
+        for (size_t i = 0; i < dim; i++) {
+            moments.sums[i].add(row[i]);
+            for (size_t j = i; j < dim; j++) {
+                moments.products[pair++].add_product(row[i], row[j]);
+            }
+        }
+    }
+    return moments;
+}
+
+void PCAMoments::merge(const PCAMoments& other) {
+    if (other.count == 0) {
+        return;
+    }
+    if (count == 0) {
+        *this = other;
+        return;
+    }
+    if (other.sums.size() != sums.size() || other.products.size() != products.size()) {
+        throw std::runtime_error("Cannot merge PCA moments of different dimensions");
+    }
+
+    count += other.count;
+    for (size_t i = 0; i < sums.size(); i++) {
+        sums[i].add(other.sums[i]);
+    }
+    for (size_t k = 0; k < products.size(); k++) {
+        products[k].add(other.products[k]);
+    }
+}
+
+namespace {
+
+Eigen::MatrixXd partials_matrix(const std::vector<utils::ExactSum>& sums) {
+    size_t width = 1;
+    for (const utils::ExactSum& sum : sums) {
+        width = std::max(width, sum.partials().size());
+    }
+
+    Eigen::MatrixXd partials = Eigen::MatrixXd::Zero(static_cast<Eigen::Index>(sums.size()),
+                                                     static_cast<Eigen::Index>(width));
+    for (size_t i = 0; i < sums.size(); i++) {
+        const std::vector<double>& row = sums[i].partials();
+        for (size_t p = 0; p < row.size(); p++) {
+            partials(static_cast<Eigen::Index>(i), static_cast<Eigen::Index>(p)) = row[p];
+        }
+    }
+    return partials;
+}
+
+std::vector<utils::ExactSum> sums_from_partials(const Eigen::MatrixXd& partials) {
+    std::vector<utils::ExactSum> sums(static_cast<size_t>(partials.rows()));
+    for (Eigen::Index i = 0; i < partials.rows(); i++) {
+        for (Eigen::Index p = 0; p < partials.cols(); p++) {
+            sums[static_cast<size_t>(i)].add(partials(i, p));
+        }
+    }
+    return sums;
+}
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(centered, Eigen::ComputeThinV);
+}  // namespace
 
-    components_ = svd.matrixV().leftCols(n_components);
+void save_moments(const std::string& filepath, const PCAMoments& moments) {
+    io::ArrayWriter writer;
+    writer.add(Eigen::MatrixXd::Constant(1, 1, static_cast<double>(moments.count)));
+    writer.add(partials_matrix(moments.sums));
+    writer.add(partials_matrix(moments.products));
+    writer.save(filepath);
+}
 
-    Eigen::VectorXd variance = svd.singularValues().array().square() / (x.rows() - 1);
+PCAMoments load_moments(const std::string& filepath) {
+    std::vector<Eigen::MatrixXd> arrays = io::read_arrays(filepath, 3);
+    const Eigen::MatrixXd& count = arrays[0];
+    const Eigen::MatrixXd& sums = arrays[1];
+    const Eigen::MatrixXd& products = arrays[2];
+
+    if (count.size() != 1 || count(0, 0) < 0.0 ||
+        products.rows() != sums.rows() * (sums.rows() + 1) / 2 || !sums.allFinite() ||
+        !products.allFinite()) {
+        throw std::runtime_error("Inconsistent PCA moments: " + filepath);
+    }
+
+    return {static_cast<size_t>(count(0, 0)),
+            sums_from_partials(sums),
+            sums_from_partials(products)};
+}
+
+void PCA::partial_fit(const Eigen::MatrixXd& x) {
+    merge(compute_moments(x));
+}
+
+void PCA::merge(const PCAMoments& moments) {
+    moments_.merge(moments);
+}
+
+// Mean and scatter matrix from the exact sums. With S_i the column sums and P_ij the sums of
+// products, the scatter is (n P_ij - S_i S_j) / n. The numerator is formed exactly and rounded
+// once, so no cancellation error enters however large the mean is against the spread.
+void PCA::finalize(int n_components) {
+    const size_t count = moments_.count;
+    if (count < 2) {
+        throw std::runtime_error("PCA::finalize needs at least two samples");
+    }
+
+    const auto n = static_cast<double>(count);
+    const size_t dim = moments_.sums.size();
+    mean_.resize(static_cast<Eigen::Index>(dim));
+    Eigen::MatrixXd scatter(mean_.size(), mean_.size());
+
+    size_t pair = 0;
+    for (size_t i = 0; i < dim; i++) {
+        const utils::ExactSum& sum_i = moments_.sums[i];
+        mean_[static_cast<Eigen::Index>(i)] = sum_i.value() / n;
+
+        for (size_t j = i; j < dim; j++) {
+            utils::ExactSum numerator;
+            for (double p : moments_.products[pair++].partials()) {
+                numerator.add_product(p, n);
+            }
+            for (double a : sum_i.partials()) {
+                for (double b : moments_.sums[j].partials()) {
+                    numerator.add_product(-a, b);
+                }
+            }
+
+            auto r = static_cast<Eigen::Index>(i);
+            auto c = static_cast<Eigen::Index>(j);
+            scatter(r, c) = scatter(c, r) = numerator.value() / n;
+        }
+    }
+
+    Eigen::MatrixXd covariance = scatter / (n - 1.0);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(covariance);
+    if (solver.info() != Eigen::Success) {
+        throw std::runtime_error("PCA eigendecomposition failed");
+    }
+
+    // Eigenvalues come in increasing order; round-off can leave tiny negative ones
+    Eigen::VectorXd variance = solver.eigenvalues().reverse().cwiseMax(0.0);
+    components_ = solver.eigenvectors().rowwise().reverse().leftCols(n_components);
+
+    // Fix the arbitrary sign of each axis: its largest-magnitude loading is positive
+    for (int k = 0; k < components_.cols(); k++) {
+        Eigen::Index largest = 0;
+        components_.col(k).cwiseAbs().maxCoeff(&largest);
+        if (components_(largest, k) < 0.0) {
+            components_.col(k) *= -1.0;
+        }
+    }
 
     explained_var_ = variance.head(n_components) / variance.sum();
 
@@ -49,63 +211,34 @@ Eigen::MatrixXd PCA::fit_transform(const Eigen::MatrixXd& x, int n_components) {
     return transform(x);
 }
 
+// Three f64 arrays: the mean, the components (one per column) and the explained variance ratios
 void PCA::save(const std::string& filepath) const {
     if (!fitted_) {
         throw std::runtime_error("PCA::save called before fit() or load()");
     }
 
-    std::ofstream file(filepath, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file for writing: " + filepath);
-    }
-
-    file.write(reinterpret_cast<const char*>(&n_components_), sizeof(n_components_));
-
-    int mean_size = static_cast<int>(mean_.size());
-    file.write(reinterpret_cast<const char*>(&mean_size), sizeof(mean_size));
-    file.write(reinterpret_cast<const char*>(mean_.data()),
-               static_cast<std::streamsize>(mean_size * sizeof(double)));
-
-    int rows = static_cast<int>(components_.rows());
-    int cols = static_cast<int>(components_.cols());
-    file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
-    file.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
-    file.write(reinterpret_cast<const char*>(components_.data()),
-               static_cast<std::streamsize>(static_cast<size_t>(rows) * cols * sizeof(double)));
-
-    int var_size = static_cast<int>(explained_var_.size());
-    file.write(reinterpret_cast<const char*>(&var_size), sizeof(var_size));
-    file.write(reinterpret_cast<const char*>(explained_var_.data()),
-               static_cast<std::streamsize>(var_size * sizeof(double)));
+    io::ArrayWriter writer;
+    writer.add(mean_);
+    writer.add(components_);
+    writer.add(explained_var_);
+    writer.save(filepath);
 }
 
 void PCA::load(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file) {
-        throw std::runtime_error("Cannot open file for reading: " + filepath);
-    }
-
-    file.read(reinterpret_cast<char*>(&n_components_), sizeof(n_components_));
-
-    int mean_size = 0;
-    file.read(reinterpret_cast<char*>(&mean_size), sizeof(mean_size));
-    mean_.resize(mean_size);
-    file.read(reinterpret_cast<char*>(mean_.data()),
-              static_cast<std::streamsize>(mean_size * sizeof(double)));
-
-    int rows = 0;
-    int cols = 0;
-    file.read(reinterpret_cast<char*>(&rows), sizeof(rows));
-    file.read(reinterpret_cast<char*>(&cols), sizeof(cols));
-    components_.resize(rows, cols);
-    file.read(reinterpret_cast<char*>(components_.data()),
-              static_cast<std::streamsize>(static_cast<size_t>(rows) * cols * sizeof(double)));
-
-    int var_size = 0;
-    file.read(reinterpret_cast<char*>(&var_size), sizeof(var_size));
-    explained_var_.resize(var_size);
-    file.read(reinterpret_cast<char*>(explained_var_.data()),
-              static_cast<std::streamsize>(var_size * sizeof(double)));
+    std::vector<Eigen::MatrixXd> arrays = io::read_arrays(filepath, 3);
+    const Eigen::MatrixXd& mean = arrays[0];
+    const Eigen::MatrixXd& components = arrays[1];
+    const Eigen::MatrixXd& explained_var = arrays[2];
+
+    if (mean.cols() != 1 || explained_var.cols() != 1 || components.rows() != mean.rows() ||
+        components.cols() != explained_var.rows()) {
+        throw std::runtime_error("Inconsistent PCA model: " + filepath);
+    }
+
+    mean_ = mean;
+    components_ = components;
+    explained_var_ = explained_var;
+    n_components_ = static_cast<int>(components_.cols());
 
     fitted_ = true;
 }
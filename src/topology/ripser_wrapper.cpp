@@ -1,36 +1,29 @@
 #include "topology/ripser_wrapper.hpp"
 
+#include "graph/neighbor_list.hpp"
+
 #include <Eigen/Dense>
 
 #define RIPSER_AS_LIBRARY
 #include <ripser/ripser.cpp>  // NOLINT(bugprone-suspicious-include)
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace defect_gnn::topology {
 
-PersistenceResult compute_persistence_from_distances(
-    const Eigen::MatrixXd& distance_matrix,
-    double threshold,  // NOLINT(bugprone-easily-swappable-parameters)
-    unsigned num_threads) {
-    const auto N = distance_matrix.rows();
-
-    std::vector<value_t> distances;
-    distances.reserve(N * (N - 1) / 2);
-
-    for (int i = 1; i < N; i++) {
-        for (int j = 0; j < i; j++) {
-            distances.push_back(static_cast<value_t>(distance_matrix(i, j)));
-        }
-    }
-
-    compressed_lower_distance_matrix dist(std::move(distances));
+namespace {
 
-    auto thresh = static_cast<value_t>(threshold);
+PersistenceResult
+run_ripser(sparse_distance_matrix&& dist, value_t thresh, unsigned num_threads) {
     coefficient_t modulus = 2;
     float ratio = 1.0F;
 
-    ripser<sparse_distance_matrix> r(
-        sparse_distance_matrix(dist, thresh), 2, thresh, ratio, modulus, num_threads);
+    ripser<sparse_distance_matrix> r(std::move(dist), 2, thresh, ratio, modulus, num_threads);
     r.compute_barcodes();
 
     PersistenceResult result;
@@ -57,6 +50,249 @@ PersistenceResult compute_persistence_from_distances(
     return result;
 }
 
+constexpr value_t INFINITE_LENGTH = std::numeric_limits<value_t>::infinity();
+
+// One row per point of (neighbor, length) entries in increasing neighbor index
+using Adjacency = std::vector<std::vector<index_diameter_t>>;
+
+// Adjacency over the pairs with edge_length(i, j) <= thresh, and the number of such pairs. Each
+// length is computed once: the pairs within the threshold are kept from the first pass, which also
+// counts degrees so every row is allocated once.
+template <typename EdgeLength>
+std::pair<Adjacency, size_t>
+thresholded_adjacency(size_t num_points, value_t thresh, const EdgeLength& edge_length) {
+    struct Edge {
+        index_t i;
+        index_t j;
+        value_t length;
+    };
+
+    // Visiting pairs in (i, j) order lists the edges in the order the fill below needs
+    std::vector<Edge> edges;
+    std::vector<size_t> degree(num_points, 0);
+    for (size_t i = 0; i < num_points; i++) {
+        for (size_t j = i + 1; j < num_points; j++) {
+            value_t length = edge_length(i, j);
+            if (length <= thresh) {
+                edges.push_back({static_cast<index_t>(i), static_cast<index_t>(j), length});
+                degree[i]++;
+                degree[j]++;
+            }
+        }
+    }
+
+    Adjacency adjacency(num_points);
+    for (size_t i = 0; i < num_points; i++) {
+        adjacency[i].reserve(degree[i]);
+    }
+
+    // Appending in (i, j) order leaves every row in increasing neighbor index, the order Ripser's
+    // sparse coboundary enumeration expects
+    for (const Edge& e : edges) {
+        adjacency[e.i].push_back({e.j, e.length});
+        adjacency[e.j].push_back({e.i, e.length});
+    }
+
+    return {std::move(adjacency), edges.size()};
+}
+
+// Entry for neighbor x in a row, or the row's end
+std::vector<index_diameter_t>::iterator find_neighbor(std::vector<index_diameter_t>& row,
+                                                      index_t x) {
+    auto it = std::lower_bound(
+        row.begin(), row.end(), x, [](const index_diameter_t& e, index_t i) {
+            return get_index(e) < i;
+        });
+    return it != row.end() && get_index(*it) == x ? it : row.end();
+}
+
+// Removes edges (rows hold INFINITE_LENGTH for them until compact_adjacency) that are dominated at
+// every scale from their own length on, longest first, and returns how many were removed.
+// uv is dominated at scale t by a common neighbor w when every other common neighbor x of u and v
+// is adjacent to w at t; removing uv is then a strong collapse of the flag complex at t. When one
+// w works for every t >= |uv|, the filtrations with and without uv have isomorphic persistence.
+size_t collapse_dominated_edges(Adjacency& adjacency) {
+    struct Edge {
+        value_t length;
+        index_t u;
+        index_t v;
+    };
+
+    std::vector<Edge> edges;
+    for (size_t u = 0; u < adjacency.size(); u++) {
+        for (const index_diameter_t& entry : adjacency[u]) {
+            if (static_cast<size_t>(get_index(entry)) > u) {
+                edges.push_back({get_diameter(entry), static_cast<index_t>(u), get_index(entry)});
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.length != b.length ? a.length > b.length : std::tie(a.u, a.v) < std::tie(b.u, b.v);
+    });
+
+    std::vector<index_t> common;
+    std::vector<value_t> joins;  // scale at which each common neighbor joins, never before |uv|
+    size_t num_collapsed = 0;
+
+    for (const Edge& e : edges) {
+        std::vector<index_diameter_t>& row_u = adjacency[e.u];
+        std::vector<index_diameter_t>& row_v = adjacency[e.v];
+
+        // Both rows are sorted by neighbor, so their common neighbors come from one merge. Neither
+        // row holds its own point, so u and v never appear.
+        common.clear();
+        joins.clear();
+        auto a = row_u.begin();
+        auto b = row_v.begin();
+        while (a != row_u.end() && b != row_v.end()) {
+            if (get_index(*a) < get_index(*b)) {
+                ++a;
+            } else if (get_index(*b) < get_index(*a)) {
+                ++b;
+            } else {
+                if (get_diameter(*a) != INFINITE_LENGTH && get_diameter(*b) != INFINITE_LENGTH) {
+                    common.push_back(get_index(*a));
+                    joins.push_back(std::max({get_diameter(*a), get_diameter(*b), e.length}));
+                }
+                ++a;
+                ++b;
+            }
+        }
+
+        for (size_t c = 0; c < common.size(); c++) {
+            // w must already be a common neighbor when uv appears
+            if (joins[c] != e.length) {
+                continue;
+            }
+
+            // common is in increasing index too, so one pass along w's row finds every wx
+            const std::vector<index_diameter_t>& row_w = adjacency[common[c]];
+            auto wx = row_w.begin();
+            bool dominates = true;
+            for (size_t k = 0; k < common.size() && dominates; k++) {
+                if (k != c) {
+                    while (wx != row_w.end() && get_index(*wx) < common[k]) {
+                        ++wx;
+                    }
+                    dominates = wx != row_w.end() && get_index(*wx) == common[k] &&
+                                get_diameter(*wx) <= joins[k];
+                }
+            }
+
+            if (dominates) {
+                find_neighbor(row_u, e.v)->second = INFINITE_LENGTH;
+                find_neighbor(row_v, e.u)->second = INFINITE_LENGTH;
+                num_collapsed++;
+                break;
+            }
+        }
+    }
+
+    return num_collapsed;
+}
+
+// Drops the entries collapse_dominated_edges marked as removed
+void compact_adjacency(Adjacency& adjacency) {
+    for (std::vector<index_diameter_t>& row : adjacency) {
+        std::erase_if(row, [](const index_diameter_t& e) {
+            return get_diameter(e) == INFINITE_LENGTH;
+        });
+    }
+}
+
+// Flag-complex persistence of num_points vertices with pairwise edge_length, optionally after
+// collapsing dominated edges
+template <typename EdgeLength>
+PersistenceResult rips_persistence(size_t num_points,
+                                   const EdgeLength& edge_length,
+                                   value_t thresh,
+                                   unsigned num_threads,
+                                   const PersistenceOptions& options) {
+    auto [adjacency, num_edges] = thresholded_adjacency(num_points, thresh, edge_length);
+
+    size_t num_collapsed = 0;
+    if (options.collapse_edges) {
+        num_collapsed = collapse_dominated_edges(adjacency);
+        compact_adjacency(adjacency);
+    }
+
+    // Like the dense constructor, Ripser's edge count covers both directions
+    const auto num_kept = static_cast<index_t>(2 * (num_edges - num_collapsed));
+    PersistenceResult result =
+        run_ripser(sparse_distance_matrix(std::move(adjacency), num_kept), thresh, num_threads);
+    result.num_edges = num_edges;
+    result.num_collapsed_edges = num_collapsed;
+
+    if (options.collapse_edges && options.counters) {
+        options.counters->edges += num_edges;
+        options.counters->collapsed += num_collapsed;
+    }
+
+    return result;
+}
+
+// Prefix of the greedy permutation from vertex 0: each step adds the point farthest from those
+// already chosen, until every point is within `radius` of one. Returned in ascending order, with
+// the final farthest distance in `cover_radius`.
+template <typename Distance>
+std::vector<size_t> greedy_landmarks(size_t num_points,
+                                     const Distance& distance,
+                                     double radius,
+                                     double& cover_radius) {
+    std::vector<double> to_landmarks(num_points, std::numeric_limits<double>::infinity());
+    std::vector<size_t> landmarks;
+
+    size_t next = 0;
+    while (true) {
+        landmarks.push_back(next);
+        to_landmarks[next] = 0.0;
+
+        size_t farthest = next;
+        cover_radius = 0.0;
+        for (size_t i = 0; i < num_points; i++) {
+            if (to_landmarks[i] > 0.0) {
+                to_landmarks[i] = std::min(to_landmarks[i], distance(next, i));
+                if (to_landmarks[i] > cover_radius) {
+                    cover_radius = to_landmarks[i];
+                    farthest = i;
+                }
+            }
+        }
+
+        if (cover_radius <= radius) {
+            break;
+        }
+        next = farthest;
+    }
+
+    std::sort(landmarks.begin(), landmarks.end());
+    return landmarks;
+}
+
+}  // namespace
+
+PersistenceResult compute_persistence_from_distances(
+    const Eigen::MatrixXd& distance_matrix,
+    double threshold,  // NOLINT(bugprone-easily-swappable-parameters)
+    unsigned num_threads) {
+    const auto N = distance_matrix.rows();
+
+    std::vector<value_t> distances;
+    distances.reserve(N * (N - 1) / 2);
+
+    for (int i = 1; i < N; i++) {
+        for (int j = 0; j < i; j++) {
+            distances.push_back(static_cast<value_t>(distance_matrix(i, j)));
+        }
+    }
+
+    compressed_lower_distance_matrix dist(std::move(distances));
+
+    auto thresh = static_cast<value_t>(threshold);
+
+    return run_ripser(sparse_distance_matrix(dist, thresh), thresh, num_threads);
+}
+
 PersistenceResult
 compute_persistence(const Eigen::MatrixXd& point_cloud, double threshold, unsigned num_threads) {
     const auto N = point_cloud.rows();
@@ -69,4 +305,74 @@ compute_persistence(const Eigen::MatrixXd& point_cloud, double threshold, unsign
     return compute_persistence_from_distances(dist, threshold, num_threads);
 }
 
-}  // namespace defect_gnn::topology
\ No newline at end of file
+PersistenceResult compute_neighborhood_persistence(const graph::NeighborView<double>& neighbors,
+                                                   double threshold,
+                                                   unsigned num_threads,
+                                                   const PersistenceOptions& options) {
+    const size_t num_points = neighbors.size() + 1;
+    auto thresh = static_cast<value_t>(threshold);
+
+    // Vertex 0 is the center, vertex k + 1 is neighbor k
+    auto distance = [&](size_t i, size_t j) {
+        if (i > j) {
+            std::swap(i, j);
+        }
+        if (i == 0) {
+            return neighbors.distances[j - 1];
+        }
+        double dx = neighbors.dx[j - 1] - neighbors.dx[i - 1];
+        double dy = neighbors.dy[j - 1] - neighbors.dy[i - 1];
+        double dz = neighbors.dz[j - 1] - neighbors.dz[i - 1];
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    };
+
+    if (options.landmark_radius <= 0.0) {
+        PersistenceResult result = rips_persistence(
+            num_points,
+            [&](size_t i, size_t j) { return static_cast<value_t>(distance(i, j)); },
+            thresh,
+            num_threads,
+            options);
+        result.num_landmarks = num_points;
+        return result;
+    }
+
+    double cover_radius = 0.0;
+    std::vector<size_t> landmarks =
+        greedy_landmarks(num_points, distance, options.landmark_radius, cover_radius);
+
+    PersistenceResult result = rips_persistence(
+        landmarks.size(),
+        [&](size_t a, size_t b) {
+            return static_cast<value_t>(distance(landmarks[a], landmarks[b]));
+        },
+        thresh,
+        num_threads,
+        options);
+    result.num_landmarks = landmarks.size();
+    result.cover_radius = cover_radius;
+    return result;
+}
+
+double estimate_persistence_cost(const graph::NeighborView<double>& neighbors,
+                                 double threshold) {
+    const size_t num_neighbors = neighbors.size();
+    const double threshold_sq = threshold * threshold;
+
+    size_t num_edges = 0;
+    for (size_t k = 0; k < num_neighbors; k++) {
+        num_edges += neighbors.distances[k] <= threshold ? 1 : 0;
+        for (size_t l = k + 1; l < num_neighbors; l++) {
+            double dx = neighbors.dx[l] - neighbors.dx[k];
+            double dy = neighbors.dy[l] - neighbors.dy[k];
+            double dz = neighbors.dz[l] - neighbors.dz[k];
+            num_edges += dx * dx + dy * dy + dz * dz <= threshold_sq ? 1 : 0;
+        }
+    }
+
+    auto num_points = static_cast<double>(num_neighbors + 1);
+    double mean_degree = 2.0 * static_cast<double>(num_edges) / num_points;
+    return num_points * (1.0 + mean_degree * mean_degree);
+}
+
+}  // namespace defect_gnn::topology
@@ -1,8 +1,8 @@
 #include "io/vasp_parser.hpp"
 #include "viz/wasm_api.hpp"
 
+#include <algorithm>
 #include <emscripten/bind.h>
-#include <sstream>
 
 namespace defect_gnn::viz {
 
@@ -12,115 +12,18 @@ constexpr int LATTICE_ROWS = 3;
 constexpr int LATTICE_COLS = 3;
 constexpr int COORDS_PER_ATOM = 3;
 
-double parse_scale_factor(std::istream& stream) {
-    std::string line;
-    std::getline(stream, line);
-    const double kScale = std::stod(line);
-    return kScale;
-}
-
-Eigen::Matrix3d parse_lattice_vectors(std::istream& stream, double scale) {
-    Eigen::Matrix3d lattice;
-    std::string line;
-
-    for (int i = 0; i < LATTICE_ROWS; ++i) {
-        std::getline(stream, line);
-        std::istringstream lss(line);
-        lss >> lattice(i, 0) >> lattice(i, 1) >> lattice(i, 2);
-    }
-
-    return lattice * scale;
-}
-
-std::vector<std::string> parse_element_symbols(std::istream& stream) {
-    std::string line;
-    std::getline(stream, line);
-    std::istringstream ess(line);
-
-    std::vector<std::string> elements;
-    std::string elem;
-    while (ess >> elem) {
-        elements.push_back(elem);
-    }
-
-    return elements;
-}
-
-std::pair<std::vector<int>, int> parse_element_counts(std::istream& stream) {
-    std::string line;
-    std::getline(stream, line);
-    std::istringstream css(line);
-
-    std::vector<int> counts;
-    int total = 0;
-    int count = 0;
-
-    while (css >> count) {
-        counts.push_back(count);
-        total += count;
-    }
-
-    return {counts, total};
-}
-
-void parse_atom_positions(std::istream& stream,
-                          int total_atoms,
-                          const std::vector<int>& counts,
-                          Eigen::MatrixXd& frac_coords,
-                          std::vector<int>& atom_types) {
-    std::string line;
-
-    // Skip coordinate type line (Direct/Cartesian)
-    std::getline(stream, line);
-
-    frac_coords.resize(total_atoms, COORDS_PER_ATOM);
-    atom_types.resize(static_cast<size_t>(total_atoms));
-
-    int atom_idx = 0;
-    for (size_t type = 0; type < counts.size(); ++type) {
-        for (int i = 0; i < counts[type]; ++i) {
-            std::getline(stream, line);
-            std::istringstream pss(line);
-            pss >> frac_coords(atom_idx, 0) >> frac_coords(atom_idx, 1) >> frac_coords(atom_idx, 2);
-            atom_types[static_cast<size_t>(atom_idx)] = static_cast<int>(type);
-            ++atom_idx;
-        }
-    }
-}
-
-io::VASPStructure parse_vasp_string(const std::string& content) {
-    io::VASPStructure result;
-    std::istringstream stream(content);
-    std::string line;
-
-    // Line 1: comment (skip)
-    std::getline(stream, line);
-
-    // Line 2: scale factor
-    const double kScale = parse_scale_factor(stream);
-
-    // Lines 3-5: lattice vectors
-    result.lattice = parse_lattice_vectors(stream, kScale);
-
-    // Line 6: element symbols
-    result.elements = parse_element_symbols(stream);
-
-    // Line 7: element counts
-    auto [counts, total] = parse_element_counts(stream);
-    result.counts = counts;
-
-    // Remaining lines: atom positions
-    parse_atom_positions(stream, total, result.counts, result.frac_coords, result.atom_types);
-
-    return result;
-}
+// Upper ends of the viewer's cutoff and max-neighbors sliders. The superset list is built at least
+// this large so moving either slider only filters it.
+constexpr double SUPERSET_CUTOFF = 10.0;
+constexpr size_t SUPERSET_MAX_NEIGHBORS = 24;
 
 }  // namespace
 
 bool WasmAPI::load_structure(const std::string& vasp_content) {
     try {
-        vasp_ = std::make_unique<io::VASPStructure>(parse_vasp_string(vasp_content));
+        vasp_ = std::make_unique<io::VASPStructure>(io::parse_vasp_string(vasp_content));
         structure_ = std::make_unique<crystal::Structure>(*vasp_);
+        superset_.reset();
         neighbors_.reset();
         return true;
     } catch (const std::exception& /*unused*/) {
@@ -132,7 +35,14 @@ void WasmAPI::build_graph(double r_cutoff, size_t max_neighbors) {
     if (!structure_) {
         return;
     }
-    neighbors_ = std::make_unique<graph::NeighborList>(*structure_, r_cutoff, max_neighbors);
+    if (!superset_ || !superset_->covers(r_cutoff, max_neighbors)) {
+        superset_ = std::make_unique<graph::NeighborList>(
+            *structure_,
+            std::max(r_cutoff, SUPERSET_CUTOFF),
+            std::max(max_neighbors, SUPERSET_MAX_NEIGHBORS));
+    }
+    neighbors_ =
+        std::make_unique<graph::NeighborList>(superset_->filtered(r_cutoff, max_neighbors));
 }
 
 // === Structure accessors ===
@@ -149,14 +59,14 @@ std::vector<float> WasmAPI::get_positions() const {
         return {};
     }
 
-    const auto& atoms = structure_->atoms();
+    const size_t kNumAtoms = structure_->num_atoms();
     std::vector<float> positions;
-    positions.reserve(static_cast<size_t>(atoms.size()) * COORDS_PER_ATOM);
+    positions.reserve(kNumAtoms * COORDS_PER_ATOM);
 
-    for (const auto& atom : atoms) {
-        positions.push_back(static_cast<float>(atom.position.x()));
-        positions.push_back(static_cast<float>(atom.position.y()));
-        positions.push_back(static_cast<float>(atom.position.z()));
+    for (size_t i = 0; i < kNumAtoms; ++i) {
+        positions.push_back(static_cast<float>(structure_->x()[i]));
+        positions.push_back(static_cast<float>(structure_->y()[i]));
+        positions.push_back(static_cast<float>(structure_->z()[i]));
     }
 
     return positions;
@@ -208,14 +118,7 @@ size_t WasmAPI::num_edges() const {
         return 0;
     }
 
-    size_t count = 0;
-    const size_t kNumAtoms = structure_->num_atoms();
-
-    for (size_t i = 0; i < kNumAtoms; ++i) {
-        count += neighbors_->neighbors(i).size();
-    }
-
-    return count;
+    return neighbors_->num_edges();
 }
 
 std::vector<int> WasmAPI::get_edge_sources() const {
@@ -223,15 +126,13 @@ std::vector<int> WasmAPI::get_edge_sources() const {
         return {};
     }
 
+    const auto& offsets = neighbors_->table().offsets;
     std::vector<int> sources;
     sources.reserve(num_edges());
     const size_t kNumAtoms = structure_->num_atoms();
 
     for (size_t i = 0; i < kNumAtoms; ++i) {
-        const auto& nbrs = neighbors_->neighbors(i);
-        for (size_t j = 0; j < nbrs.size(); ++j) {
-            sources.push_back(static_cast<int>(i));
-        }
+        sources.insert(sources.end(), offsets[i + 1] - offsets[i], static_cast<int>(i));
     }
 
     return sources;
@@ -242,17 +143,8 @@ std::vector<int> WasmAPI::get_edge_targets() const {
         return {};
     }
 
-    std::vector<int> targets;
-    targets.reserve(num_edges());
-    const size_t kNumAtoms = structure_->num_atoms();
-
-    for (size_t i = 0; i < kNumAtoms; ++i) {
-        for (const auto& neighbor : neighbors_->neighbors(i)) {
-            targets.push_back(static_cast<int>(neighbor.idx));
-        }
-    }
-
-    return targets;
+    const auto& indices = neighbors_->table().indices;
+    return {indices.begin(), indices.end()};
 }
 
 std::vector<float> WasmAPI::get_edge_distances() const {
@@ -260,17 +152,8 @@ std::vector<float> WasmAPI::get_edge_distances() const {
         return {};
     }
 
-    std::vector<float> distances;
-    distances.reserve(num_edges());
-    const size_t kNumAtoms = structure_->num_atoms();
-
-    for (size_t i = 0; i < kNumAtoms; ++i) {
-        for (const auto& neighbor : neighbors_->neighbors(i)) {
-            distances.push_back(static_cast<float>(neighbor.distance));
-        }
-    }
-
-    return distances;
+    const auto& distances = neighbors_->table().distances;
+    return {distances.begin(), distances.end()};
 }
 
 std::vector<float> WasmAPI::get_edge_displacements() const {
@@ -278,16 +161,14 @@ std::vector<float> WasmAPI::get_edge_displacements() const {
         return {};
     }
 
+    const auto& table = neighbors_->table();
     std::vector<float> displacements;
-    displacements.reserve(static_cast<size_t>(num_edges()) * COORDS_PER_ATOM);
-    const size_t kNumAtoms = structure_->num_atoms();
+    displacements.reserve(table.num_edges() * COORDS_PER_ATOM);
 
-    for (size_t i = 0; i < kNumAtoms; ++i) {
-        for (const auto& neighbor : neighbors_->neighbors(i)) {
-            displacements.push_back(static_cast<float>(neighbor.displacement.x()));
-            displacements.push_back(static_cast<float>(neighbor.displacement.y()));
-            displacements.push_back(static_cast<float>(neighbor.displacement.z()));
-        }
+    for (size_t edge = 0; edge < table.num_edges(); ++edge) {
+        displacements.push_back(static_cast<float>(table.dx[edge]));
+        displacements.push_back(static_cast<float>(table.dy[edge]));
+        displacements.push_back(static_cast<float>(table.dz[edge]));
     }
 
     return displacements;
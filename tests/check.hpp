@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal assertion for the test executables: reports the failing expression and exits non-zero
+// so ctest marks the test failed. Unlike assert() it stays active in release builds.
+#define CHECK(condition)                                                                       \
+    do {                                                                                       \
+        if (!(condition)) {                                                                    \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            std::exit(EXIT_FAILURE);                                                           \
+        }                                                                                      \
+    } while (false)
@@ -0,0 +1,133 @@
+#include "check.hpp"
+#include "io/binary_format.hpp"
+
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace defect_gnn;
+
+namespace {
+
+std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void write_file(const std::string& path, const std::string& bytes) {
+    std::ofstream(path, std::ios::binary) << bytes;
+}
+
+bool read_throws(const std::string& path, size_t expected_arrays) {
+    try {
+        (void)io::read_arrays(path, expected_arrays);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+// Same bits, so NaN, infinities and signed zeros compare as stored
+bool bitwise_equal(const Eigen::MatrixXd& a, const Eigen::MatrixXd& b) {
+    return a.rows() == b.rows() && a.cols() == b.cols() &&
+           std::memcmp(a.data(), b.data(), static_cast<size_t>(a.size()) * sizeof(double)) == 0;
+}
+
+}  // namespace
+
+int main() {
+    const std::string dir =
+        (std::filesystem::temp_directory_path() / "test_binary_format").string();
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/arrays.bin";
+
+    // Feature-like columns: repeated values, smooth runs and a few special values
+    Eigen::MatrixXd features = Eigen::MatrixXd::Zero(50, 35);
+    features.col(0).setConstant(12.0);
+    features.col(1) = Eigen::VectorXd::LinSpaced(50, 0.5, 3.5);
+    features.col(2) = Eigen::VectorXd::Random(50);
+    features(3, 4) = -0.0;
+    features(4, 4) = std::numeric_limits<double>::infinity();
+    features(5, 4) = std::numeric_limits<double>::quiet_NaN();
+    features(6, 4) = std::numeric_limits<double>::denorm_min();
+
+    const std::vector<Eigen::MatrixXd> arrays = {
+        features, Eigen::MatrixXd(0, 35), Eigen::MatrixXd::Random(1, 1)};
+
+    for (io::Codec codec : {io::Codec::RAW, io::Codec::SHUFFLE_DELTA}) {
+        // f64 is lossless under either codec
+        io::ArrayWriter writer({io::Dtype::F64, codec});
+        for (const Eigen::MatrixXd& array : arrays) {
+            writer.add(array);
+        }
+        writer.save(path);
+
+        std::vector<Eigen::MatrixXd> loaded = io::read_arrays(path, arrays.size());
+        CHECK(loaded.size() == arrays.size());
+        for (size_t i = 0; i < arrays.size(); i++) {
+            CHECK(bitwise_equal(loaded[i], arrays[i]));
+        }
+        CHECK(read_throws(path, arrays.size() - 1));
+
+        // Narrow types round to their precision and keep the shape
+        Eigen::MatrixXd finite = Eigen::MatrixXd::Random(20, 35) * 100.0;
+        for (auto [dtype, tolerance] : {std::pair{io::Dtype::F32, 1e-7}, {io::Dtype::BF16, 4e-3}}) {
+            io::ArrayWriter narrow({dtype, codec});
+            narrow.add(finite);
+            narrow.save(path);
+
+            Eigen::MatrixXd back = io::read_arrays(path, 1)[0];
+            CHECK(back.rows() == finite.rows() && back.cols() == finite.cols());
+            CHECK(((back - finite).cwiseAbs().array() <= tolerance * finite.cwiseAbs().array())
+                      .all());
+        }
+    }
+
+    // Compression pays off on the repetitive columns
+    io::ArrayWriter raw;
+    raw.add(features);
+    raw.save(dir + "/raw.bin");
+    io::ArrayWriter packed({io::Dtype::F64, io::Codec::SHUFFLE_DELTA});
+    packed.add(features);
+    packed.save(dir + "/packed.bin");
+    CHECK(std::filesystem::file_size(dir + "/packed.bin") <
+          std::filesystem::file_size(dir + "/raw.bin") / 2);
+
+    // Any damage is caught before anything is returned
+    const std::string bytes = read_file(dir + "/packed.bin");
+    for (size_t position : {size_t{0}, size_t{9}, size_t{20}, bytes.size() / 2, bytes.size() - 1}) {
+        std::string damaged = bytes;
+        damaged[position] = static_cast<char>(damaged[position] ^ 0x10);
+        write_file(path, damaged);
+        CHECK(read_throws(path, 1));
+    }
+    for (size_t length : {size_t{0}, size_t{7}, size_t{30}, bytes.size() - 1}) {
+        write_file(path, bytes.substr(0, length));
+        CHECK(read_throws(path, 1));
+    }
+    write_file(path, bytes + '\0');
+    CHECK(read_throws(path, 1));
+    CHECK(read_throws(dir + "/missing.bin", 1));
+
+    CHECK(io::parse_dtype("bf16") == io::Dtype::BF16);
+    bool threw = false;
+    try {
+        (void)io::parse_dtype("f16");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
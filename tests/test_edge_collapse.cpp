@@ -0,0 +1,89 @@
+#include "check.hpp"
+#include "crystal/structure.hpp"
+#include "graph/neighbor_list.hpp"
+#include "io/vasp_parser.hpp"
+#include "topology/ripser_wrapper.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+
+using namespace defect_gnn;
+
+namespace {
+
+constexpr double R_CUTOFF = 5.0;
+
+// The collapse leaves the pairs in a different order
+topology::PersistenceDiagram sorted(topology::PersistenceDiagram diagram) {
+    std::sort(diagram.begin(), diagram.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.birth, a.death) < std::tie(b.birth, b.death);
+    });
+    return diagram;
+}
+
+bool same_diagram(const topology::PersistenceDiagram& a, const topology::PersistenceDiagram& b) {
+    topology::PersistenceDiagram sa = sorted(a);
+    topology::PersistenceDiagram sb = sorted(b);
+    return std::equal(sa.begin(), sa.end(), sb.begin(), sb.end(), [](const auto& x, const auto& y) {
+        return x.birth == y.birth && x.death == y.death;
+    });
+}
+
+// Triclinic cell with random edge lengths, tilts and atom positions
+crystal::Structure random_cell(size_t num_atoms, std::mt19937& rng) {
+    std::uniform_real_distribution<double> length(5.0, 7.0);
+    std::uniform_real_distribution<double> tilt(-1.5, 1.5);
+    std::uniform_real_distribution<double> fraction(0.0, 1.0);
+
+    std::string poscar = "random\n1.0\n";
+    poscar += std::to_string(length(rng)) + " 0 0\n";
+    poscar += std::to_string(tilt(rng)) + " " + std::to_string(length(rng)) + " 0\n";
+    poscar += std::to_string(tilt(rng)) + " " + std::to_string(tilt(rng)) + " " +
+              std::to_string(length(rng)) + "\n";
+    poscar += "A\n" + std::to_string(num_atoms) + "\nDirect\n";
+    for (size_t i = 0; i < num_atoms; i++) {
+        poscar += std::to_string(fraction(rng)) + " " + std::to_string(fraction(rng)) + " " +
+                  std::to_string(fraction(rng)) + "\n";
+    }
+    return crystal::Structure(io::parse_vasp_string(poscar));
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(11);
+
+    topology::CollapseCounters counters;
+    topology::PersistenceOptions collapse;
+    collapse.collapse_edges = true;
+    collapse.counters = &counters;
+
+    for (int trial = 0; trial < 4; trial++) {
+        crystal::Structure structure = random_cell(12, rng);
+        graph::NeighborList neighbor_list(
+            structure, R_CUTOFF, std::numeric_limits<size_t>::max(), 1e-10);
+
+        for (size_t i = 0; i < structure.num_atoms(); i++) {
+            graph::NeighborView<double> neighbors = neighbor_list.neighbors(i);
+            topology::PersistenceResult full =
+                topology::compute_neighborhood_persistence(neighbors, R_CUTOFF, 1);
+            topology::PersistenceResult collapsed =
+                topology::compute_neighborhood_persistence(neighbors, R_CUTOFF, 1, collapse);
+
+            CHECK(same_diagram(full.dim0, collapsed.dim0));
+            CHECK(same_diagram(full.dim1, collapsed.dim1));
+            CHECK(same_diagram(full.dim2, collapsed.dim2));
+            CHECK(collapsed.num_edges == full.num_edges);
+        }
+    }
+
+    // Dense neighborhoods leave most edges dominated; a collapse that removed nothing would pass
+    // the comparison above trivially
+    CHECK(counters.collapsed > 0);
+    CHECK(counters.collapsed < counters.edges);
+    return 0;
+}
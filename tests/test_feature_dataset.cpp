@@ -0,0 +1,106 @@
+#include "check.hpp"
+#include "topology/feature_dataset.hpp"
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace defect_gnn;
+
+namespace {
+
+bool open_throws(const std::string& path) {
+    try {
+        topology::FeatureDataset dataset(path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    const std::string dir =
+        (std::filesystem::temp_directory_path() / "test_feature_dataset").string();
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/betti.pack";
+
+    const std::vector<std::string> ids = {"1", "1_1", "741", "1046_2"};
+    std::vector<Eigen::MatrixXd> features;
+    for (Eigen::Index rows : {5, 0, 13, 1}) {
+        features.push_back(Eigen::MatrixXd::Random(rows, 35));
+    }
+
+    topology::FeatureDatasetWriter writer(path);
+    for (size_t i = 0; i < ids.size(); i++) {
+        writer.add(ids[i], features[i]);
+    }
+    CHECK(!std::filesystem::exists(path));  // only visible once finished
+    writer.finish();
+
+    {
+        topology::FeatureDataset dataset(path);
+        CHECK(dataset.size() == ids.size());
+        CHECK(dataset.cols() == 35);
+
+        for (size_t i = 0; i < ids.size(); i++) {
+            CHECK(dataset.id(i) == ids[i]);
+            CHECK(dataset.find(ids[i]) == std::optional<size_t>(i));
+
+            topology::FeatureView view = dataset.features(ids[i]);
+            CHECK(view.rows() == features[i].rows());
+            CHECK(view == features[i]);
+            CHECK(reinterpret_cast<uintptr_t>(view.data()) % topology::FEATURE_DATASET_ALIGNMENT ==
+                  0);
+        }
+
+        CHECK(!dataset.find("999").has_value());
+        bool threw = false;
+        try {
+            (void)dataset.features(std::string_view("999"));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    // Matrices of a different width cannot join the pack
+    topology::FeatureDatasetWriter mixed(dir + "/mixed.pack");
+    mixed.add("1", features[0]);
+    bool threw = false;
+    try {
+        mixed.add("2", Eigen::MatrixXd::Zero(2, 34));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    // A wrong magic, a truncated index and a file shorter than the header are all rejected
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    auto write = [&](const std::string& name, const std::string& content) {
+        std::ofstream(dir + "/" + name, std::ios::binary) << content;
+        return dir + "/" + name;
+    };
+    std::string bad_magic = bytes;
+    bad_magic[0] = 'X';
+    CHECK(open_throws(write("magic.pack", bad_magic)));
+    CHECK(open_throws(write("truncated.pack", bytes.substr(0, bytes.size() - 40))));
+    CHECK(open_throws(write("short.pack", bytes.substr(0, 10))));
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
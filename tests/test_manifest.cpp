@@ -0,0 +1,69 @@
+#include "check.hpp"
+#include "io/manifest.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+using namespace defect_gnn;
+
+int main() {
+    const std::string dir = (std::filesystem::temp_directory_path() / "test_manifest").string();
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/manifest.tsv";
+
+    {
+        io::Manifest manifest(path);
+        CHECK(manifest.size() == 0);
+        manifest.append({"a", 0x1, 0x2, {0x3, 0x4}});
+        manifest.append({"b", 0x5, 0x6, {0x7}});
+        manifest.append({"a", 0x8, 0x2, {0x9}});
+    }
+
+    // Entries survive a reload, and the last line for an id wins
+    {
+        io::Manifest manifest(path);
+        CHECK(manifest.size() == 2);
+        auto a = manifest.find("a");
+        CHECK(a && a->input_hash == 0x8 && a->params_hash == 0x2);
+        CHECK(a->output_checksums == (std::vector<uint64_t>{0x9}));
+        auto b = manifest.find("b");
+        CHECK(b && b->output_checksums == (std::vector<uint64_t>{0x7}));
+        CHECK(!manifest.find("c"));
+    }
+
+    // A crash midway through a line leaves it without its newline. The torn entry is dropped,
+    // even where it happens to parse, and the next append lands on its own line.
+    std::ofstream(path, std::ios::app) << "#comment\nd\t0000000000";
+    {
+        io::Manifest manifest(path);
+        CHECK(manifest.size() == 2);
+        CHECK(!manifest.find("d"));
+        manifest.append({"c", 0xa, 0xb, {0xc}});
+        manifest.append({"e", 0xd, 0xe, {0xf}});
+    }
+    {
+        io::Manifest manifest(path);
+        CHECK(manifest.size() == 4);
+        CHECK(!manifest.find("d"));
+        auto c = manifest.find("c");
+        CHECK(c && c->input_hash == 0xa && c->output_checksums == (std::vector<uint64_t>{0xc}));
+        auto e = manifest.find("e");
+        CHECK(e && e->input_hash == 0xd);
+    }
+
+    std::ofstream(path, std::ios::app) << "f\t0000000000000001\t0000000000000002\t00000003";
+    {
+        io::Manifest manifest(path);
+        CHECK(!manifest.find("f"));
+        manifest.append({"g", 0x1, 0x1, {0x1}});
+    }
+    CHECK(io::Manifest(path).find("g"));
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "check.hpp"
+#include "crystal/structure.hpp"
+#include "graph/neighbor_list.hpp"
+#include "io/vasp_parser.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+using namespace defect_gnn;
+
+namespace {
+
+// Cubic cell of side `a` with one atom per line of fractional coordinates
+crystal::Structure cubic_cell(double a, const std::string& positions, const std::string& counts) {
+    std::string side = std::to_string(a);
+    std::string poscar = "test\n1.0\n" + side + " 0 0\n0 " + side + " 0\n0 0 " + side +
+                         "\nA B\n" + counts + "\nDirect\n" + positions;
+    return crystal::Structure(io::parse_vasp_string(poscar));
+}
+
+void check_same_rows(const graph::NeighborList& derived, const graph::NeighborList& direct) {
+    CHECK(derived.num_atoms() == direct.num_atoms());
+    for (size_t i = 0; i < direct.num_atoms(); i++) {
+        graph::NeighborView<double> a = derived.neighbors(i);
+        graph::NeighborView<double> b = direct.neighbors(i);
+        CHECK(a.size() == b.size());
+        for (size_t k = 0; k < b.size(); k++) {
+            CHECK(a.indices[k] == b.indices[k]);
+            CHECK(std::abs(a.distances[k] - b.distances[k]) < 1e-12);
+            CHECK((a.displacement(k) - b.displacement(k)).norm() < 1e-12);
+        }
+    }
+}
+
+// The cutoff spans several cells, so every full row holds many images of the removed atom
+void check_vacancy_in_small_cell(graph::NeighborBackend backend) {
+    crystal::Structure host = cubic_cell(3.0, "0 0 0\n0.5 0.5 0.5\n", "1 1");
+    crystal::Structure vacancy = cubic_cell(3.0, "0 0 0\n", "1 0");
+
+    graph::NeighborList host_neighbors(host, 8.0, 10, 1e-10, backend);
+    graph::NeighborList direct(vacancy, 8.0, 10, 1e-10, backend);
+    graph::NeighborList derived = host_neighbors.with_vacancy(host, 1);
+
+    CHECK(derived.neighbors(0).size() == 10);
+    check_same_rows(derived, direct);
+}
+
+// Less symmetric cell where only some rows were cut at max_neighbors
+void check_vacancy_in_skewed_cell(graph::NeighborBackend backend) {
+    crystal::Structure host =
+        cubic_cell(4.0, "0 0 0\n0.31 0.52 0.07\n0.5 0.5 0.5\n0.8 0.1 0.6\n", "2 2");
+    crystal::Structure vacancy = cubic_cell(4.0, "0 0 0\n0.5 0.5 0.5\n0.8 0.1 0.6\n", "1 2");
+
+    for (size_t max_neighbors : {4, 12, 40}) {
+        graph::NeighborList host_neighbors(host, 7.0, max_neighbors, 1e-10, backend);
+        graph::NeighborList direct(vacancy, 7.0, max_neighbors, 1e-10, backend);
+        check_same_rows(host_neighbors.with_vacancy(host, 1), direct);
+    }
+}
+
+}  // namespace
+
+int main() {
+    for (graph::NeighborBackend backend :
+         {graph::NeighborBackend::KDTree, graph::NeighborBackend::CellList}) {
+        check_vacancy_in_small_cell(backend);
+        check_vacancy_in_skewed_cell(backend);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "check.hpp"
+#include "crystal/structure.hpp"
+#include "graph/neighbor_list.hpp"
+#include "io/vasp_parser.hpp"
+#include "topology/betti_features.hpp"
+#include "topology/ripser_wrapper.hpp"
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <limits>
+#include <string>
+
+using namespace defect_gnn;
+
+namespace {
+
+constexpr double R_CUTOFF = 5.0;
+
+crystal::Structure cubic_cell(double a, const std::string& positions, const std::string& counts) {
+    std::string side = std::to_string(a);
+    std::string poscar = "test\n1.0\n" + side + " 0 0\n0 " + side + " 0\n0 0 " + side +
+                         "\nA B\n" + counts + "\nDirect\n" + positions;
+    return crystal::Structure(io::parse_vasp_string(poscar));
+}
+
+// Rows scattered over symmetry orbits must equal the rows each atom computes on its own, bit for
+// bit, with and without landmarks
+void check_scattered_rows(const crystal::Structure& structure,
+                          const topology::PersistenceOptions& options) {
+    graph::NeighborList neighbor_list(
+        structure, R_CUTOFF, std::numeric_limits<size_t>::max(), 1e-10);
+    Eigen::MatrixXd scattered = topology::compute_structure_betti_features(
+        structure, neighbor_list, R_CUTOFF, 2, nullptr, options);
+
+    CHECK(scattered.rows() == static_cast<Eigen::Index>(structure.num_atoms()));
+    for (size_t i = 0; i < structure.num_atoms(); i++) {
+        Eigen::VectorXd own = topology::compute_atom_betti_features(
+            structure, i, neighbor_list, R_CUTOFF, 1, options);
+        CHECK(scattered.row(static_cast<Eigen::Index>(i)).transpose() == own);
+    }
+}
+
+}  // namespace
+
+int main() {
+    // Rock salt: every A and every B atom is equivalent
+    crystal::Structure rock_salt = cubic_cell(4.2,
+                                              "0 0 0\n0 0.5 0.5\n0.5 0 0.5\n0.5 0.5 0\n"
+                                              "0.5 0 0\n0 0.5 0\n0 0 0.5\n0.5 0.5 0.5\n",
+                                              "4 4");
+    // Fluorite-like cell with off-lattice coordinates, so neighbor offsets are not all exact
+    crystal::Structure fluorite = cubic_cell(5.1,
+                                             "0 0 0\n0 0.5 0.5\n0.5 0 0.5\n0.5 0.5 0\n"
+                                             "0.25 0.25 0.25\n0.75 0.75 0.25\n"
+                                             "0.75 0.25 0.75\n0.25 0.75 0.75\n"
+                                             "0.75 0.75 0.75\n0.25 0.25 0.75\n"
+                                             "0.25 0.75 0.25\n0.75 0.25 0.25\n",
+                                             "4 8");
+    // One atom moved by less than the symmetry tolerance, so orbits hold atoms whose neighborhoods
+    // differ in the last bits
+    crystal::Structure nudged = cubic_cell(4.2,
+                                           "0 0 0\n0 0.5 0.5\n0.5 0 0.5\n0.5 0.5 0.0000001\n"
+                                           "0.5 0 0\n0 0.5 0\n0 0 0.5\n0.5 0.5 0.5\n",
+                                           "4 4");
+
+    topology::PersistenceOptions exact;
+    topology::PersistenceOptions landmarks;
+    landmarks.landmark_radius = 1.5;
+
+    for (const crystal::Structure* structure : {&rock_salt, &fluorite, &nudged}) {
+        check_scattered_rows(*structure, exact);
+        check_scattered_rows(*structure, landmarks);
+    }
+    return 0;
+}
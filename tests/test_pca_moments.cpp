@@ -0,0 +1,99 @@
+#include "check.hpp"
+#include "topology/betti_features.hpp"
+#include "topology/pca.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace defect_gnn;
+
+namespace {
+
+bool same_sums(const std::vector<utils::ExactSum>& a, const std::vector<utils::ExactSum>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const auto& x, const auto& y) {
+        return x.value() == y.value();
+    });
+}
+
+bool load_throws(const std::string& path) {
+    try {
+        (void)topology::load_moments(path);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    const std::string dir = (std::filesystem::temp_directory_path() / "test_pca_moments").string();
+    std::filesystem::create_directories(dir);
+
+    Eigen::MatrixXd x = Eigen::MatrixXd::Random(300, topology::BETTI_FEATURE_DIM);
+    x.col(3) *= 10.0;
+
+    // Moments survive a save and load exactly
+    topology::PCAMoments moments = topology::compute_moments(x);
+    topology::save_moments(dir + "/moments.bin", moments);
+    topology::PCAMoments loaded = topology::load_moments(dir + "/moments.bin");
+    CHECK(loaded.count == moments.count);
+    CHECK(same_sums(loaded.sums, moments.sums));
+    CHECK(same_sums(loaded.products, moments.products));
+
+    // An empty shard round-trips too and merges as a no-op
+    topology::save_moments(dir + "/empty.bin", topology::PCAMoments{});
+    CHECK(topology::load_moments(dir + "/empty.bin").count == 0);
+
+    // Shard-level moments, saved and merged in any order, give exactly the model of one fit over
+    // all rows, here fed one small batch at a time as the pipeline does
+    topology::PCA whole;
+    for (Eigen::Index r = 0; r < x.rows(); r += 7) {
+        whole.partial_fit(x.middleRows(r, std::min<Eigen::Index>(7, x.rows() - r)));
+    }
+    whole.finalize(6);
+
+    const Eigen::Index bounds[] = {0, 70, 71, 200, 300};
+    for (int s = 0; s < 4; s++) {
+        topology::PCA shard;
+        shard.partial_fit(x.middleRows(bounds[s], bounds[s + 1] - bounds[s]));
+        topology::save_moments(dir + "/shard" + std::to_string(s) + ".bin", shard.moments());
+    }
+
+    for (const auto& order : {std::array{0, 1, 2, 3}, std::array{3, 1, 0, 2}}) {
+        topology::PCA merged;
+        for (int s : order) {
+            merged.merge(topology::load_moments(dir + "/shard" + std::to_string(s) + ".bin"));
+        }
+        merged.merge(topology::load_moments(dir + "/empty.bin"));
+        merged.finalize(6);
+
+        CHECK(merged.num_samples() == whole.num_samples());
+        CHECK(merged.mean() == whole.mean());
+        CHECK(merged.components() == whole.components());
+        CHECK(merged.explained_variance_ratio() == whole.explained_variance_ratio());
+    }
+
+    // The exact sums keep a large offset from swamping the spread
+    topology::PCA offset;
+    offset.fit((x.array() + 1e9).matrix(), 6);
+    CHECK((offset.components() - whole.components()).cwiseAbs().maxCoeff() < 1e-6);
+
+    // A PCA model file holds three arrays too, but not in the moments' shapes
+    whole.save(dir + "/model.bin");
+    CHECK(load_throws(dir + "/model.bin"));
+
+    std::ofstream(dir + "/truncated.bin", std::ios::binary) << "DGNNARR";
+    CHECK(load_throws(dir + "/truncated.bin"));
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
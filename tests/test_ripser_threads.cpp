@@ -0,0 +1,74 @@
+#include "check.hpp"
+#include "topology/ripser_wrapper.hpp"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <tuple>
+
+using namespace defect_gnn;
+
+namespace {
+
+// Threaded reduction may report pairs in any order
+topology::PersistenceDiagram sorted(topology::PersistenceDiagram diagram) {
+    std::sort(diagram.begin(), diagram.end(), [](const auto& a, const auto& b) {
+        return std::tie(a.birth, a.death) < std::tie(b.birth, b.death);
+    });
+    return diagram;
+}
+
+bool same_diagram(const topology::PersistenceDiagram& a, const topology::PersistenceDiagram& b) {
+    topology::PersistenceDiagram sa = sorted(a);
+    topology::PersistenceDiagram sb = sorted(b);
+    return std::equal(sa.begin(), sa.end(), sb.begin(), sb.end(), [](const auto& x, const auto& y) {
+        return x.birth == y.birth && x.death == y.death;
+    });
+}
+
+void check_same_result(const topology::PersistenceResult& a, const topology::PersistenceResult& b) {
+    CHECK(same_diagram(a.dim0, b.dim0));
+    CHECK(same_diagram(a.dim1, b.dim1));
+    CHECK(same_diagram(a.dim2, b.dim2));
+}
+
+Eigen::MatrixXd random_points(Eigen::Index count, std::mt19937& rng) {
+    std::uniform_real_distribution<double> coordinate(0.0, 6.0);
+    Eigen::MatrixXd points(count, 3);
+    for (Eigen::Index i = 0; i < points.size(); i++) {
+        points.data()[i] = coordinate(rng);
+    }
+    return points;
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(7);
+
+    for (int trial = 0; trial < 3; trial++) {
+        Eigen::MatrixXd points = random_points(80 + 40 * trial, rng);
+
+        // The single-threaded run before and after the threaded ones checks that the reused
+        // per-thread scratch is neither corrupted by nor corrupts the worker threads' state
+        topology::PersistenceResult serial = topology::compute_persistence(points, 2.5, 1);
+        CHECK(!serial.dim1.empty());
+
+        for (unsigned num_threads : {2U, 4U}) {
+            check_same_result(topology::compute_persistence(points, 2.5, num_threads), serial);
+        }
+        check_same_result(topology::compute_persistence(points, 2.5, 1), serial);
+    }
+
+    // A problem large enough that its scratch is freed afterwards rather than kept; the small
+    // problems on this thread before and after it must agree
+    Eigen::MatrixXd small = random_points(60, rng);
+    topology::PersistenceResult before = topology::compute_persistence(small, 2.5, 1);
+    Eigen::MatrixXd large = random_points(600, rng);
+    check_same_result(topology::compute_persistence(large, 2.5, 1),
+                      topology::compute_persistence(large, 2.5, 4));
+    check_same_result(topology::compute_persistence(small, 2.5, 1), before);
+    return 0;
+}
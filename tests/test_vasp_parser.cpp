@@ -0,0 +1,108 @@
+#include "check.hpp"
+#include "io/vasp_parser.hpp"
+
+#include <Eigen/Dense>
+
+#include <filesystem>
+#include <fstream>
+#include <ios>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace defect_gnn;
+
+namespace {
+
+// Whether parsing throws with a message containing `expected`
+bool rejects(std::string_view content, const std::string& expected) {
+    try {
+        (void)io::parse_vasp_string(content);
+    } catch (const std::runtime_error& e) {
+        return std::string(e.what()).find(expected) != std::string::npos;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main() {
+    // Scale factor, several species, a selective dynamics flag after a position and a '+' sign
+    const std::string direct = "Ga2 N1\n"
+                               "  2.0\n"
+                               "  1.5 0.0 0.0\n"
+                               "  0.0 2.0 0.0\n"
+                               "  0.0 0.0 +2.5\n"
+                               "  Ga N\n"
+                               "  2 1\n"
+                               "Direct\n"
+                               "  0.0 0.0 0.0\n"
+                               "  0.5 0.25 0.125 T T F\n"
+                               "  1e-1 -0.75 0.333333333333333315\n";
+
+    io::VASPStructure vasp = io::parse_vasp_string(direct);
+    Eigen::Matrix3d lattice = Eigen::Vector3d(3.0, 4.0, 5.0).asDiagonal();
+    CHECK(vasp.lattice == lattice);
+    CHECK(vasp.elements == (std::vector<std::string>{"Ga", "N"}));
+    CHECK(vasp.counts == (std::vector<int>{2, 1}));
+    CHECK(vasp.atom_types == (std::vector<int>{0, 0, 1}));
+    CHECK(vasp.frac_coords.rows() == 3);
+    CHECK(vasp.frac_coords.row(1) == Eigen::RowVector3d(0.5, 0.25, 0.125));
+    CHECK(vasp.frac_coords(2, 0) == 0.1);
+    CHECK(vasp.frac_coords(2, 1) == -0.75);
+    CHECK(vasp.frac_coords(2, 2) == 0.333333333333333315);
+
+    // Windows line endings and tabs parse the same
+    std::string crlf;
+    for (char c : direct) {
+        crlf += c == '\n' ? std::string("\r\n") : std::string(1, c == ' ' ? '\t' : c);
+    }
+    io::VASPStructure from_crlf = io::parse_vasp_string(crlf);
+    CHECK(from_crlf.lattice == vasp.lattice);
+    CHECK(from_crlf.frac_coords == vasp.frac_coords);
+
+    // Cartesian positions are converted to fractional ones
+    const std::string cartesian = "cell\n1.0\n4 0 0\n0 4 0\n0 0 4\nSi\n2\nCartesian\n"
+                                  "0 0 0\n2 1 3\n";
+    io::VASPStructure converted = io::parse_vasp_string(cartesian);
+    CHECK((converted.frac_coords.row(1) - Eigen::RowVector3d(0.5, 0.25, 0.75)).norm() < 1e-15);
+
+    // A file parses exactly like its content
+    const std::string dir = (std::filesystem::temp_directory_path() / "test_vasp_parser").string();
+    std::filesystem::create_directories(dir);
+    std::ofstream(dir + "/POSCAR", std::ios::binary) << direct;
+    io::VASPStructure from_file = io::parse_vasp(dir + "/POSCAR");
+    CHECK(from_file.lattice == vasp.lattice);
+    CHECK(from_file.frac_coords == vasp.frac_coords);
+    CHECK(from_file.elements == vasp.elements);
+
+    // Malformed input names the line at fault
+    std::ofstream(dir + "/empty", std::ios::binary).close();
+    bool threw = false;
+    try {
+        (void)io::parse_vasp(dir + "/empty");
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()).find("line 1: unexpected end of file") != std::string::npos;
+    }
+    CHECK(threw);
+
+    CHECK(rejects("x\nfoo\n", "line 2: expected a scale factor"));
+    CHECK(rejects("x\n1\n1 0 0\n0 1 0\n", "line 5: unexpected end of file"));
+    CHECK(rejects("x\n1\n1 0 0\n0 1\n0 0 1\n", "line 4: expected three lattice"));
+    CHECK(rejects("x\n1\n1 0 0\n0 1 0\n0 0 1\nA\n-1\nD\n", "line 7: negative element count"));
+    CHECK(rejects("x\n1\n1 0 0\n0 1 0\n0 0 1\nA\n2\nD\n0 0 0\n0.5 0.5 abc\n",
+                  "line 10: expected three atom coordinates"));
+    CHECK(rejects("x\n1\n1 0 0\n0 1 0\n0 0 1\nA\n2\nD\n0 0 0\n", "line 10: unexpected end"));
+
+    threw = false;
+    try {
+        (void)io::parse_vasp(dir + "/missing");
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
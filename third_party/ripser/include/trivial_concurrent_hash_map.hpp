@@ -33,6 +33,8 @@ class trivial_concurrent_hash_map
             storage_.resize(sz, dummy());
         }
 
+        void                clear()                 { storage_.clear(); }
+
         inline iterator     find(Key k);
         inline std::pair<iterator,bool>
                             insert(value_type x);
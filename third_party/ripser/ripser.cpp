@@ -178,25 +178,48 @@ void check_overflow(index_t i) {
                                   std::to_string(max_simplex_index));
 }
 
+// Per-thread scratch is kept from one call to the next only while it stays below this many
+// entries. Past it, the scratch is freed once the call ends, so a thread that ran one heavy problem
+// does not hold that problem's peak memory for the rest of the process.
+constexpr size_t MAX_RETAINED_SCRATCH = size_t(1) << 16;
+
 class binomial_coeff_table {
-    std::vector<std::vector<index_t>> B;
+    index_t n_max = -1, k_max = -1;
+    std::vector<index_t> B;  // (n_max + 1) x (k_max + 1), row-major
+
+    index_t& at(index_t n, index_t k) { return B[n * (k_max + 1) + k]; }
 
 public:
-    binomial_coeff_table(index_t n, index_t k) : B(n + 1) {
+    binomial_coeff_table() = default;
+
+    binomial_coeff_table(index_t n, index_t k)
+        : n_max(n), k_max(k), B((n + 1) * (k + 1), 0) {
         for (index_t i = 0; i <= n; ++i) {
-            B[i].resize(k + 1, 0);
-            B[i][0] = 1;
+            at(i, 0) = 1;
             for (index_t j = 1; j < std::min(i, k + 1); ++j)
-                B[i][j] = B[i - 1][j - 1] + B[i - 1][j];
+                at(i, j) = at(i - 1, j - 1) + at(i - 1, j);
             if (i <= k)
-                B[i][i] = 1;
-            check_overflow(B[i][std::min(i >> 1, k)]);
+                at(i, i) = 1;
+            check_overflow(at(i, std::min(i >> 1, k)));
         }
     }
 
+    // Entries do not depend on the table's extent, so one table per thread is grown on demand
+    // and shared by every ripser instance built on that thread. A table grown past
+    // MAX_RETAINED_SCRATCH for one large problem is cut back by the next small one.
+    static const binomial_coeff_table& cached(index_t n, index_t k) {
+        thread_local binomial_coeff_table table;
+        if (n > table.n_max || k > table.k_max)
+            table = binomial_coeff_table(std::max(n, table.n_max), std::max(k, table.k_max));
+        else if (table.B.size() > MAX_RETAINED_SCRATCH &&
+                 size_t(n + 1) * size_t(k + 1) <= MAX_RETAINED_SCRATCH)
+            table = binomial_coeff_table(n, k);
+        return table;
+    }
+
     index_t operator()(index_t n, index_t k) const {
-        assert(n < B.size() && k < B[n].size() && n >= k - 1);
-        return B[n][k];
+        assert(n <= n_max && k <= k_max && n >= k - 1);
+        return B[n * (k_max + 1) + k];
     }
 };
 
@@ -519,7 +542,7 @@ class ripser {
     const float ratio;
     const coefficient_t modulus;
     const unsigned num_threads;
-    const binomial_coeff_table binomial_coeff;
+    const binomial_coeff_table& binomial_coeff;
     const std::vector<coefficient_t> multiplicative_inverse;
 
 public:
@@ -546,7 +569,21 @@ private:
     typedef std::priority_queue<diameter_entry_t,
                                 std::vector<diameter_entry_t>,
                                 greater_diameter_or_smaller_index<diameter_entry_t>>
-        WorkingColumn;
+        WorkingColumnBase;
+
+    struct WorkingColumn : WorkingColumnBase {
+        void clear() { this->c.clear(); }  // keeps the capacity for the next column
+        size_t capacity() const { return this->c.capacity(); }
+    };
+
+    // Frees per-thread scratch that grew past MAX_RETAINED_SCRATCH entries
+    template <class T> static void release_if_over(T& scratch, size_t entries) {
+        if (entries > MAX_RETAINED_SCRATCH)
+            scratch = T();
+    }
+
+    static inline thread_local std::vector<diameter_entry_t> scratch_cofacets;
+    static inline thread_local WorkingColumn scratch_reduction_column, scratch_coboundary;
 
 public:
     ripser(DistanceMatrix&& _dist,
@@ -566,7 +603,7 @@ public:
 #else
           num_threads(1),
 #endif
-          binomial_coeff(n, dim_max + 2),
+          binomial_coeff(binomial_coeff_table::cached(n, dim_max + 2)),
           multiplicative_inverse(multiplicative_inverse_vector(_modulus)) {
         persistence_pairs.resize(dim_max + 1);
     }
@@ -614,13 +651,7 @@ public:
 
         std::vector<std::vector<diameter_index_t>> next_simplices_vec(num_threads),
             columns_to_reduce_vec(num_threads);
-#if defined(USE_TBB)
-        tbb::parallel_for<unsigned>(0, num_threads, [&](unsigned i) {
-#else
-        std::vector<std::future<void>> handles;
-        for (unsigned i = 0; i < num_threads; ++i)
-            handles.emplace_back(std::async(std::launch::async, [&, i]() {
-#endif
+        auto gather = [&](unsigned i) {
             std::vector<diameter_index_t>& next_simplices = next_simplices_vec[i];
             std::vector<diameter_index_t>& columns_to_reduce = columns_to_reduce_vec[i];
 #ifdef INDICATE_PROGRESS
@@ -658,43 +689,52 @@ public:
                 }
                 cur_chunk = achunk++;
             }
-#if defined(USE_TBB)
-        });
-#else
-            }));
-        handles.clear();
-#endif
+        };
 
-        // figure out offsets to put everything together and resize
-        std::vector<size_t> simplices_prefix{0}, columns_to_reduce_prefix{0};
-        for (unsigned i = 0; i < num_threads; ++i) {
-            simplices_prefix.push_back(simplices_prefix.back() + next_simplices_vec[i].size());
-            columns_to_reduce_prefix.push_back(columns_to_reduce_prefix.back() +
-                                               columns_to_reduce_vec[i].size());
-        }
-        next_simplices.resize(simplices_prefix.back());
-        columns_to_reduce.resize(columns_to_reduce_prefix.back());
-
-        // copy into the arrays
+        if (num_threads == 1) {
+            // small problems: no worker threads, and the single output needs no merging
+            gather(0);
+            next_simplices.swap(next_simplices_vec[0]);
+            columns_to_reduce.swap(columns_to_reduce_vec[0]);
+        } else {
 #if defined(USE_TBB)
-        tbb::parallel_for<unsigned>(0, num_threads, [&](unsigned i) {
+            tbb::parallel_for<unsigned>(0, num_threads, gather);
 #else
-        for (unsigned i = 0; i < num_threads; ++i)
-            handles.emplace_back(std::async(std::launch::async, [&, i]() {
+            std::vector<std::future<void>> handles;
+            for (unsigned i = 0; i < num_threads; ++i)
+                handles.emplace_back(std::async(std::launch::async, gather, i));
+            handles.clear();
 #endif
-            size_t k = 0;
-            for (size_t j = simplices_prefix[i]; j < simplices_prefix[i + 1]; ++j)
-                next_simplices[j] = next_simplices_vec[i][k++];
 
-            k = 0;
-            for (size_t j = columns_to_reduce_prefix[i]; j < columns_to_reduce_prefix[i + 1]; ++j)
-                columns_to_reduce[j] = columns_to_reduce_vec[i][k++];
+            // figure out offsets to put everything together and resize
+            std::vector<size_t> simplices_prefix{0}, columns_to_reduce_prefix{0};
+            for (unsigned i = 0; i < num_threads; ++i) {
+                simplices_prefix.push_back(simplices_prefix.back() + next_simplices_vec[i].size());
+                columns_to_reduce_prefix.push_back(columns_to_reduce_prefix.back() +
+                                                   columns_to_reduce_vec[i].size());
+            }
+            next_simplices.resize(simplices_prefix.back());
+            columns_to_reduce.resize(columns_to_reduce_prefix.back());
+
+            // copy into the arrays
+            auto copy = [&](unsigned i) {
+                size_t k = 0;
+                for (size_t j = simplices_prefix[i]; j < simplices_prefix[i + 1]; ++j)
+                    next_simplices[j] = next_simplices_vec[i][k++];
+
+                k = 0;
+                for (size_t j = columns_to_reduce_prefix[i]; j < columns_to_reduce_prefix[i + 1];
+                     ++j)
+                    columns_to_reduce[j] = columns_to_reduce_vec[i][k++];
+            };
 #if defined(USE_TBB)
-        });
+            tbb::parallel_for<unsigned>(0, num_threads, copy);
 #else
-            }));
-        handles.clear();  // force execution
+            for (unsigned i = 0; i < num_threads; ++i)
+                handles.emplace_back(std::async(std::launch::async, copy, i));
+            handles.clear();  // force execution
 #endif
+        }
 
         simplices.swap(next_simplices);
 
@@ -712,10 +752,16 @@ public:
                            columns_to_reduce.end(),
                            greater_diameter_or_smaller_index<diameter_index_t>());
 #else
-        boost::sort::parallel::parallel_sort(columns_to_reduce.begin(),
-                                             columns_to_reduce.end(),
-                                             greater_diameter_or_smaller_index<diameter_index_t>(),
-                                             num_threads);
+        if (num_threads == 1)
+            std::sort(columns_to_reduce.begin(),
+                      columns_to_reduce.end(),
+                      greater_diameter_or_smaller_index<diameter_index_t>());
+        else
+            boost::sort::parallel::parallel_sort(
+                columns_to_reduce.begin(),
+                columns_to_reduce.end(),
+                greater_diameter_or_smaller_index<diameter_index_t>(),
+                num_threads);
 #endif
 #ifdef INDICATE_PROGRESS
         std::cerr << clear_line << std::flush;
@@ -801,7 +847,7 @@ public:
                                   entry_hash_map& pivot_column_index,
                                   Matrix& reduction_matrix,
                                   const size_t index_column_to_reduce) {
-        thread_local static std::vector<diameter_entry_t> cofacet_entries;
+        std::vector<diameter_entry_t>& cofacet_entries = scratch_cofacets;
         bool check_for_emergent_pair = true;
         cofacet_entries.clear();
         simplex_coboundary_enumerator cofacets(simplex, dim, *this);
@@ -880,6 +926,15 @@ public:
         return new MatrixColumn(std::move(column));
     }
 
+    // Whether foreach below runs every column on the calling thread
+    bool reduces_inline() const {
+#if defined(USE_PARALLEL_STL) || defined(USE_TBB)
+        return false;
+#else
+        return num_threads == 1;
+#endif
+    }
+
     template <class F>
     void foreach (const std::vector<diameter_index_t>& columns_to_reduce, const F& f) {
 #if defined(INDICATE_PROGRESS) && !defined(USE_SERIAL)
@@ -970,49 +1025,54 @@ public:
         unsigned n_threads = num_threads;
 
         int epoch_counter = 0;
-        std::vector<std::thread> threads;
-        for (unsigned t = 0; t < n_threads; ++t)
-            threads.emplace_back([&]() {
-                mrzv::atomic_ref<size_t> achunk(chunk);
+        auto work = [&]() {
+            mrzv::atomic_ref<size_t> achunk(chunk);
 
-                mrzv::MemoryManager<MatrixColumn> memory_manager(epoch_counter, n_threads);
+            mrzv::MemoryManager<MatrixColumn> memory_manager(epoch_counter, n_threads);
 
     #ifdef INDICATE_PROGRESS
-                int indicate_progress = progress++;
-                std::chrono::steady_clock::time_point next =
-                    std::chrono::steady_clock::now() + time_step;
+            int indicate_progress = progress++;
+            std::chrono::steady_clock::time_point next =
+                std::chrono::steady_clock::now() + time_step;
     #endif
 
-                size_t cur_chunk = achunk++;
-                while (cur_chunk * chunk_size < columns_to_reduce.size()) {
-                    size_t from = cur_chunk * chunk_size;
-                    size_t to = std::min((cur_chunk + 1) * chunk_size, columns_to_reduce.size());
+            size_t cur_chunk = achunk++;
+            while (cur_chunk * chunk_size < columns_to_reduce.size()) {
+                size_t from = cur_chunk * chunk_size;
+                size_t to = std::min((cur_chunk + 1) * chunk_size, columns_to_reduce.size());
     #ifdef INDICATE_PROGRESS
-                    if (indicate_progress == 0) {
-                        if (std::chrono::steady_clock::now() > next) {
-                            std::cerr << clear_line << "reducing columns " << from << " - " << to
-                                      << "/" << columns_to_reduce.size() << std::flush;
-                            next = std::chrono::steady_clock::now() + time_step;
-                        }
+                if (indicate_progress == 0) {
+                    if (std::chrono::steady_clock::now() > next) {
+                        std::cerr << clear_line << "reducing columns " << from << " - " << to
+                                  << "/" << columns_to_reduce.size() << std::flush;
+                        next = std::chrono::steady_clock::now() + time_step;
                     }
+                }
     #endif
-                    for (size_t idx = from; idx < to; ++idx) {
-                        size_t index_column_to_reduce = idx;
-                        bool first = true;
-                        size_t next;
-                        do {
-                            next = index_column_to_reduce;
-                            index_column_to_reduce = f(next, first, memory_manager);
-                            first = false;
-                        } while (next != index_column_to_reduce);
-                    }
-                    cur_chunk = achunk++;
-                    memory_manager.quiescent();
+                for (size_t idx = from; idx < to; ++idx) {
+                    size_t index_column_to_reduce = idx;
+                    bool first = true;
+                    size_t next;
+                    do {
+                        next = index_column_to_reduce;
+                        index_column_to_reduce = f(next, first, memory_manager);
+                        first = false;
+                    } while (next != index_column_to_reduce);
                 }
-            });
+                cur_chunk = achunk++;
+                memory_manager.quiescent();
+            }
+        };
 
-        for (auto& thread : threads)
-            thread.join();
+        if (n_threads == 1) {
+            work();  // small problems reduce on the calling thread
+        } else {
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < n_threads; ++t)
+                threads.emplace_back(work);
+            for (auto& thread : threads)
+                thread.join();
+        }
 #endif
     }
 
@@ -1046,8 +1106,16 @@ public:
         // extra vector is a work-around inability to store floats in the hash_map
         typedef hash_map<entry_t, size_t, entry_hash, equal_index> entry_diameter_index_map;
         std::atomic<size_t> last_diameter_index{0};
-        std::vector<value_t> diameters(columns_to_reduce.size());
-        entry_diameter_index_map deaths;
+        // The worker threads below write to these, so only the inline path may reuse this
+        // thread's copies; every other run shares fresh ones
+        thread_local static std::vector<value_t> cached_diameters;
+        thread_local static entry_diameter_index_map cached_deaths;
+        std::vector<value_t> shared_diameters;
+        entry_diameter_index_map shared_deaths;
+        std::vector<value_t>& diameters = reduces_inline() ? cached_diameters : shared_diameters;
+        entry_diameter_index_map& deaths = reduces_inline() ? cached_deaths : shared_deaths;
+        diameters.resize(columns_to_reduce.size());
+        deaths.clear();
         deaths.reserve(columns_to_reduce.size());
 #endif
 
@@ -1062,7 +1130,10 @@ public:
                 diameter_entry_t column_to_reduce(columns_to_reduce[index_column_to_reduce], 1);
                 value_t diameter = get_diameter(column_to_reduce);
 
-                WorkingColumn working_reduction_column, working_coboundary;
+                WorkingColumn& working_reduction_column = scratch_reduction_column;
+                WorkingColumn& working_coboundary = scratch_coboundary;
+                working_reduction_column.clear();
+                working_coboundary.clear();
 
                 diameter_entry_t pivot;
                 if (first) {
@@ -1245,7 +1316,12 @@ public:
             }
         });
         // TODO: this doesn't print/store unpaired values in parallel case
+        release_if_over(cached_diameters, cached_diameters.capacity());
+        release_if_over(cached_deaths, columns_to_reduce.size());
 #endif
+        release_if_over(scratch_reduction_column, scratch_reduction_column.capacity());
+        release_if_over(scratch_coboundary, scratch_coboundary.capacity());
+        release_if_over(scratch_cofacets, scratch_cofacets.capacity());
     }
 
     std::vector<diameter_index_t> get_edges();
@@ -1255,9 +1331,15 @@ public:
 
         compute_dim_0_pairs(simplices, columns_to_reduce);
 
+        // Reused across dimensions and across calls on this thread, so repeated small problems
+        // keep one table instead of reallocating it
+        thread_local static entry_hash_map pivot_column_index;
+        size_t peak_columns = 0;
+
         for (index_t dim = 1; dim <= dim_max; ++dim) {
-            entry_hash_map pivot_column_index;
+            pivot_column_index.clear();
             pivot_column_index.reserve(columns_to_reduce.size());
+            peak_columns = std::max(peak_columns, columns_to_reduce.size());
 
             compute_pairs(columns_to_reduce, pivot_column_index, dim);
 
@@ -1265,6 +1347,7 @@ public:
                 assemble_columns_to_reduce(
                     simplices, columns_to_reduce, pivot_column_index, dim + 1);
         }
+        release_if_over(pivot_column_index, peak_columns);
     }
 };
 
@@ -1319,11 +1402,11 @@ template <>
 class ripser<sparse_distance_matrix>::simplex_coboundary_enumerator {
     const ripser& parent;
     index_t idx_below, idx_above, k;
-    std::vector<index_t> vertices;
     const diameter_entry_t simplex;
     const coefficient_t modulus;
     const sparse_distance_matrix& dist;
     const binomial_coeff_table& binomial_coeff;
+    static thread_local std::vector<index_t> vertices;
     static thread_local std::vector<std::vector<index_diameter_t>::const_reverse_iterator>
         neighbor_it;
     static thread_local std::vector<std::vector<index_diameter_t>::const_reverse_iterator>
@@ -1338,11 +1421,11 @@ public:
           idx_below(get_index(_simplex)),
           idx_above(0),
           k(_dim + 1),
-          vertices(_dim + 1),
           simplex(_simplex),
           modulus(parent.modulus),
           dist(parent.dist),
           binomial_coeff(parent.binomial_coeff) {
+        vertices.resize(_dim + 1);
         neighbor_it.clear();
         neighbor_end.clear();
 
@@ -1389,6 +1472,8 @@ public:
     }
 };
 
+thread_local std::vector<index_t>
+    ripser<sparse_distance_matrix>::simplex_coboundary_enumerator::vertices;
 thread_local std::vector<std::vector<index_diameter_t>::const_reverse_iterator>
     ripser<sparse_distance_matrix>::simplex_coboundary_enumerator::neighbor_it;
 thread_local std::vector<std::vector<index_diameter_t>::const_reverse_iterator>